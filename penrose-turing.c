@@ -1,9 +1,32 @@
 #define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <argp.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// A growable byte buffer.
+struct buffer {
+  char* data;
+  size_t len;
+  size_t cap;
+};
+void buffer_append(struct buffer* b, const void* data, size_t n);
 
 // Configuration for argp.
 const char* argp_program_version = "0.1.0";
@@ -19,18 +42,135 @@ printed in the format used by Penrose, except that state numbers will be \
 printed in hexadecimal instead of binary.\n\
 \n\
 If the tape is specified then the verbosity level controls the output. \
+\n\
+The machine is executed by one of several engines: \"flat\" (the default) \
+keeps the tape in a single contiguous buffer, \"paged\" keeps only recently \
+visited pages of the tape as plain cells and the rest run-length encoded, \
+with identical pages shared, \"disk\" keeps the tape in a scratch file in \
+$TMPDIR (default: /var/tmp) with a buffer of recently visited pages, so that \
+the tape is bounded by disk space when --max-tape-length is none, and \
+\"reference\" is a deliberately simple implementation used to validate the \
+others. With \
+--cross-check, the reference engine runs in lockstep with the selected engine \
+on a separate thread and the first divergence between them is reported.\
+\n\
+With --convert-from and --convert-to, the machines in the --input file are \
+converted between Penrose's encoding (one specification per line), the \
+standard transition-table text format (one machine per line, e.g. \
+1RB1LB_1LA---), the binary seed-database format (bbdb) and bundles. Lines \
+of text formats may be prefixed by a machine name and a tab.\
+\n\
+A bundle stores many compiled machines with an index for random access. A \
+machine is selected from a --tm-bundle with --tm-id or --tm-name, or with \
+--batch every machine is run on the tape and one tab-separated line is \
+printed per machine: its name, its status (halted, max-steps, \
+max-tape-length or invalid) and its result.\
+\n\
+With --serve NAME, the machines of a bundle are served from a job queue in \
+/dev/shm/NAME until --stop-server NAME, SIGINT or SIGTERM. Clients on the same host \
+run --submit NAME with \"K TAPE\" lines on standard input; tapes and results are \
+passed in shared memory and the output is as with --batch, with machine \
+indexes for names.\
+\n\
+Tapes for --batch may also come from a tape corpus, a file of packed tapes \
+with an index that is mapped and read without parsing; every machine is then \
+run on every tape, and the tape index follows the name. --pack-tapes and \
+--unpack-tapes convert between the --input file and a corpus, with text \
+tapes one per line. With --tape-corpus, --submit reads \"K T\" lines, T being \
+a tape index.\
+\n\
+On machines with several NUMA nodes, worker threads are spread over the \
+nodes and pinned to them; --batch and --serve workers read machines from a \
+copy of the bundle in their node's memory and take work from their own node \
+before taking it from others.\
+\n\
+Breakpoints (--break-state, --break-cell, --watch-cell and --break-step, \
+each of which may be repeated) pause the run and print the configuration. \
+Cells are numbered from the initial head position, which is cell 0. Runs \
+without breakpoints execute an uninstrumented copy of the engine. With \
+--checkpoint-interval, a checkpoint is written every so many steps by a \
+forked copy of the process, so the run does not pause while it is written; a \
+periodic checkpoint is skipped if the previous one is still being written. \
+The disk engine always writes checkpoints from the running process. \
+Checkpoints are for inspection: a run cannot be resumed from one.\
+\n\
+With --certificate, a run writes a certificate that can be checked \
+independently of the engine that produced it. A halting run records its \
+configuration every --certificate-interval steps, so verification can re-run \
+the segments in parallel or sample them. A run that reaches --max-steps \
+records a non-halting witness (a repeated configuration, or an escape to \
+blank tape in one direction) if one is found. With --verify, the \
+certificates given as arguments are checked with the reference engine.\
+\n\
+Machines whose head never moves left are run as streaming transducers over \
+the tape, split across --threads, unless an engine or an instrumented run is \
+requested.\
+\n\
+With --stream-output, once the machine enters a state from which its head \
+can never move left, the result so far is printed, the tape is freed, and \
+the rest of the result is printed as it is produced. Output is then printed \
+before the run is known to halt, and the tape length limit applies to the \
+span of visited cells.\
 ";
 static struct argp_option options[] = {
   {"tm",                 'm', "TM",                  0,  "Turing machine specification TM" },
   {"tm-file",           1000, "FILE",                0,  "read Turing machine specification from FILE" },
   {"tape",               't', "TAPE",                0,  "initial tape TAPE" },
   {"tape-file",         1001, "FILE",                0,  "read initial tape from FILE" },
-  {"max-tape-length",   1002, "N",                   0,  "stop if number of cells in working tape exceeds N (default: 2^20)" },
+  {"max-tape-length",   1002, "N",                   0,  "stop if number of cells in working tape, those visited "
+                                                           "or initially on it, exceeds N, or none (default: 2^20)" },
   {"max-steps",         1003, "N",                   0,  "stop if number of Turing machine steps exceeds N (default: 2^20)" },
   {"verbosity",          'v', "N", OPTION_ARG_OPTIONAL,  "verbosity (0-2), e.g. -v -v or -v2 for level 2" },
+  {"engine",            1004, "ENGINE",              0,  "execute with ENGINE: flat, reference, paged or disk "
+                                                           "(default: flat)" },
+  {"cross-check",       1005, "N",                   0,  "compare the engine against the reference engine every N steps" },
+  {"convert-from",      1006, "FORMAT",              0,  "convert machines from FORMAT: penrose, standard, bbdb or bundle" },
+  {"convert-to",        1007, "FORMAT",              0,  "convert machines to FORMAT: penrose, standard, bbdb or bundle" },
+  {"input",             1008, "FILE",                0,  "read machines to convert from FILE" },
+  {"output",             'o', "FILE",                0,  "write output to FILE instead of standard output" },
+  {"threads",           1009, "N",                   0,  "use N worker threads (default: number of CPUs)" },
+  {"db-states",         1010, "N",                   0,  "number of states per seed-database record (default: 5)" },
+  {"tm-bundle",         1011, "FILE",                0,  "read Turing machines from the bundle FILE" },
+  {"tm-id",             1012, "K",                   0,  "use the machine with index K in the bundle" },
+  {"tm-name",           1013, "NAME",                0,  "use the machine named NAME in the bundle" },
+  {"batch",             1014, 0,                     0,  "run every machine in the bundle on the tape" },
+  {"break-state",       1015, "S",                   0,  "pause when entering state S (hexadecimal)" },
+  {"break-cell",        1016, "K",                   0,  "pause when the head reaches cell K" },
+  {"watch-cell",        1017, "K",                   0,  "pause when the value of cell K changes" },
+  {"break-step",        1018, "N",                   0,  "pause after step N" },
+  {"on-break",          1019, "ACTION",              0,  "at a breakpoint: prompt, continue, checkpoint or quit "
+                                                           "(default: prompt if standard input is a terminal, "
+                                                           "otherwise continue)" },
+  {"checkpoint",        1020, "FILE",                0,  "write checkpoints to FILE, for inspection" },
+  {"certificate",       1021, "FILE",                0,  "write a halting or non-halting certificate to FILE" },
+  {"certificate-interval", 1022, "N",                0,  "record the configuration every N steps in a certificate "
+                                                           "(default: 2^16)" },
+  {"verify",            1023, 0,                     0,  "verify the certificate files given as arguments" },
+  {"stream-output",     1025, 0,                     0,  "print the result as it is produced once the machine "
+                                                           "can no longer move left, freeing the tape" },
+  {"checkpoint-interval", 1026, "N",                0,  "write a checkpoint every N steps without pausing the run" },
+  {"checkpoint-sync",   1027, 0,                     0,  "write periodic checkpoints from the running process "
+                                                           "instead of a forked copy" },
+  {"serve",             1028, "NAME",                0,  "serve jobs for the machines in the bundle from the "
+                                                           "shared-memory queue /dev/shm/NAME" },
+  {"submit",            1029, "NAME",                0,  "submit jobs read from standard input (\"K TAPE\" per "
+                                                           "line) to the queue NAME and print the results" },
+  {"stop-server",       1030, "NAME",                0,  "ask the server of the queue NAME to finish" },
+  {"queue-slots",       1031, "N",                   0,  "number of job slots in a served queue (default: 64)" },
+  {"queue-slot-size",   1032, "N",                   0,  "bytes for the tape and result of each job in a served "
+                                                           "queue (default: 2^20)" },
+  {"pack-tapes",        1033, 0,                     0,  "pack the tapes in the --input file, one per line, into "
+                                                           "a tape corpus" },
+  {"unpack-tapes",      1034, 0,                     0,  "print the tapes in the tape corpus --input, one per line" },
+  {"tape-corpus",       1035, "FILE",                0,  "with --batch, run every machine on every tape in the "
+                                                           "corpus FILE; with --submit, read tapes from it" },
+  {"interleave",        1037, "K",                   0,  "with --batch, have each worker run K machines at once, "
+                                                           "taking turns, to hide memory latency" },
+  {"stats",             1036, 0,                     0,  "print allocation counts after --batch or --serve" },
+  {"verify-segments",   1024, "N",                   0,  "verify N randomly chosen segments of each halting "
+                                                           "certificate (default: all)" },
   //{"quiet",    'q', 0,      0,  "Don't produce any output" },
   //{"silent",   's', 0,      OPTION_ALIAS },
-  //{"output",   'o', "FILE", 0, "Output to FILE instead of standard output" },
   { 0 }
 };
 struct arguments {
@@ -41,6 +181,42 @@ struct arguments {
   const char* max_tape_len_str;
   const char* max_steps_str;
   int verbosity;
+  const char* engine;
+  const char* cross_check_str;
+  const char* convert_from;
+  const char* convert_to;
+  const char* input;
+  const char* output;
+  const char* threads_str;
+  const char* db_states_str;
+  const char* tm_bundle;
+  const char* tm_id;
+  const char* tm_name;
+  int batch;
+  struct buffer break_states; // unsigned long long each
+  struct buffer break_cells; // ssize_t each
+  struct buffer watched_cells; // ssize_t each
+  struct buffer break_steps; // unsigned long long each
+  const char* on_break;
+  const char* checkpoint;
+  const char* certificate;
+  const char* certificate_interval_str;
+  int verify;
+  const char* verify_segments_str;
+  int stream_output;
+  const char* checkpoint_interval_str;
+  int checkpoint_sync;
+  const char* serve;
+  const char* submit;
+  const char* stop_server;
+  const char* queue_slots_str;
+  const char* queue_slot_size_str;
+  int pack_tapes;
+  int unpack_tapes;
+  const char* tape_corpus;
+  int stats;
+  const char* interleave_str;
+  struct buffer files; // const char* each
 };
 static error_t parse_opt(int key, char *arg, struct argp_state *state)
 {
@@ -65,6 +241,115 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
     case 1003:
       args->max_steps_str = arg;
       break;
+    case 1004:
+      args->engine = arg;
+      break;
+    case 1005:
+      args->cross_check_str = arg;
+      break;
+    case 1006:
+      args->convert_from = arg;
+      break;
+    case 1007:
+      args->convert_to = arg;
+      break;
+    case 1008:
+      args->input = arg;
+      break;
+    case 'o':
+      args->output = arg;
+      break;
+    case 1009:
+      args->threads_str = arg;
+      break;
+    case 1010:
+      args->db_states_str = arg;
+      break;
+    case 1011:
+      args->tm_bundle = arg;
+      break;
+    case 1012:
+      args->tm_id = arg;
+      break;
+    case 1013:
+      args->tm_name = arg;
+      break;
+    case 1014:
+      args->batch = 1;
+      break;
+    case 1015: {
+      const unsigned long long n = strtoull(arg, NULL, 16);
+      buffer_append(&(args->break_states), &n, sizeof(n));
+      break;
+    }
+    case 1016:
+    case 1017: {
+      const ssize_t k = (ssize_t) strtoll(arg, NULL, 10);
+      buffer_append(key == 1016 ? &(args->break_cells) : &(args->watched_cells), &k, sizeof(k));
+      break;
+    }
+    case 1018: {
+      const unsigned long long n = strtoull(arg, NULL, 10);
+      buffer_append(&(args->break_steps), &n, sizeof(n));
+      break;
+    }
+    case 1019:
+      args->on_break = arg;
+      break;
+    case 1020:
+      args->checkpoint = arg;
+      break;
+    case 1021:
+      args->certificate = arg;
+      break;
+    case 1022:
+      args->certificate_interval_str = arg;
+      break;
+    case 1023:
+      args->verify = 1;
+      break;
+    case 1024:
+      args->verify_segments_str = arg;
+      break;
+    case 1025:
+      args->stream_output = 1;
+      break;
+    case 1026:
+      args->checkpoint_interval_str = arg;
+      break;
+    case 1027:
+      args->checkpoint_sync = 1;
+      break;
+    case 1028:
+      args->serve = arg;
+      break;
+    case 1029:
+      args->submit = arg;
+      break;
+    case 1030:
+      args->stop_server = arg;
+      break;
+    case 1031:
+      args->queue_slots_str = arg;
+      break;
+    case 1032:
+      args->queue_slot_size_str = arg;
+      break;
+    case 1033:
+      args->pack_tapes = 1;
+      break;
+    case 1034:
+      args->unpack_tapes = 1;
+      break;
+    case 1035:
+      args->tape_corpus = arg;
+      break;
+    case 1036:
+      args->stats = 1;
+      break;
+    case 1037:
+      args->interleave_str = arg;
+      break;
     case 'v':
       if (arg) {
         args->verbosity = atoi(arg);
@@ -73,10 +358,15 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
       }
       break;
     case ARGP_KEY_ARG:
-      argp_usage(state);
+      if (!args->verify) {
+        argp_usage(state);
+      }
+      buffer_append(&(args->files), &arg, sizeof(arg));
       break;
     case ARGP_KEY_SUCCESS:
-      if ((!args->tm && !args->tm_file)) {
+      if (!args->tm && !args->tm_file && !args->tm_bundle && !args->convert_from && !args->convert_to
+          && !args->verify && !args->serve && !args->submit && !args->stop_server && !args->pack_tapes
+          && !args->unpack_tapes) {
         argp_usage(state);
       }
     default:
@@ -110,17 +400,568 @@ struct state {
   struct action action1; // action to take after reading '1'
 };
 
+// Outcome of advancing an engine.
+enum status { RUNNING, HALTED, TAPE_LIMIT, BREAK };
+
+// Conditions on which an engine stops early, checked after every step. Tape
+// positions are relative to the cell under the head at step zero.
+struct breakpoints {
+  const char* states; // non-zero for each state whose entry breaks, or NULL
+  const ssize_t* cells; // positions whose arrival of the head breaks
+  size_t cells_len;
+  const ssize_t* watched_cells; // positions whose change of value breaks
+  size_t watched_cells_len;
+  enum { HIT_STATE, HIT_CELL, HIT_WATCHED_CELL } hit; // set on BREAK
+  ssize_t hit_cell; // set on BREAK for HIT_WATCHED_CELL
+  int halted; // set on BREAK, non-zero if the step that hit it halted the machine
+};
+
+// What to do when a breakpoint is hit.
+enum break_action { BREAK_PROMPT, BREAK_CONTINUE, BREAK_CHECKPOINT, BREAK_QUIT };
+static const char* const break_action_names[] = { "prompt", "continue", "checkpoint", "quit" };
+
+// Memory recycled between the runs of one worker, so that once the pool
+// holds blocks of the sizes its runs need, the worker no longer calls the
+// allocator for flat runs. Each block is preceded by its capacity. The other
+// engines allocate for themselves and only count their allocations here.
+#define RUN_POOL_BLOCKS 16
+struct run_pool {
+  char* blocks[RUN_POOL_BLOCKS]; // free blocks
+  size_t blocks_len;
+  unsigned long long allocs; // allocator calls, for blocks or by engines that bypass the pool
+  unsigned long long reuses; // blocks taken from the pool
+};
+
+// Position of a running Turing machine. Tape positions are relative to the
+// cell under the head at step zero.
+struct run_info {
+  unsigned long long step;
+  const struct state* state;
+  ssize_t head;    // position of the head
+  ssize_t min_pos; // leftmost position visited (or part of the initial tape)
+  ssize_t max_pos; // rightmost position visited (or part of the initial tape)
+};
+
+// Operations implemented by an engine. Every engine must produce exactly the
+// same sequence of configurations; --cross-check verifies that they do.
+struct engine {
+  const char* name;
+  // Creates an engine instance positioned at step zero.
+  void* (*create)(const struct state* states, const char* initial_tape,
+                  size_t initial_tape_len, size_t max_tape_len, struct run_pool* pool);
+  // Executes at most n steps, stopping early if the machine halts or the
+  // working tape exceeds the maximum length.
+  enum status (*advance)(void* e, unsigned long long n);
+  // As advance(), but also stops with BREAK after any step that hits one of
+  // the breakpoints.
+  enum status (*advance_watched)(void* e, unsigned long long n, struct breakpoints* bp);
+  void (*get_info)(const void* e, struct run_info* info);
+  // Copies n cells starting at position first into out; cells which have
+  // never been visited read as ' '.
+  void (*read_cells)(const void* e, ssize_t first, size_t n, char* out);
+  void (*destroy)(void* e);
+  // Prefetches the cells the head can reach in the next n steps, or NULL.
+  void (*prefetch)(const void* e, size_t n);
+  // Non-zero if the whole tape is in process memory, so that a forked copy
+  // of the process sees it as it was at the fork.
+  int forkable;
+};
+
+// Configuration of a running Turing machine.
+struct snapshot {
+  struct run_info info;
+  char* cells; // cells from info.min_pos to info.max_pos
+  size_t cells_cap;
+};
+
+// A certificate being recorded during a run.
+struct certificate_writer {
+  const char* path;
+  FILE* fp;
+  unsigned long long interval; // steps between recorded configurations
+  size_t states_len;
+  struct snapshot snap;
+};
+
+// Periodic checkpoints of a run.
+struct checkpointer {
+  const char* path;
+  unsigned long long interval; // steps between checkpoints
+  int sync; // non-zero to write from the stepping process
+  pid_t child; // process writing the last checkpoint, or 0
+};
+
+// Options controlling how a Turing machine is run.
+struct run_options {
+  size_t max_tape_len;
+  unsigned long long max_steps;
+  int verbosity;
+  const struct engine* engine;
+  unsigned long long cross_check_interval; // 0 to disable
+  struct breakpoints* breakpoints; // NULL if there are none
+  const unsigned long long* break_steps; // ascending
+  size_t break_steps_len;
+  enum break_action on_break;
+  const char* checkpoint; // checkpoint file, or NULL
+  struct certificate_writer* certificate; // NULL unless writing a certificate
+  struct checkpointer* checkpointer; // NULL unless checkpointing periodically
+  int streaming; // non-zero to run one-way machines as transducers
+  int stream_output; // non-zero to stream the result once the head can no longer move left
+  size_t threads; // worker threads for transducers
+  struct run_pool* pool; // memory of the worker running the machine, or NULL to use the allocator
+  int stats; // non-zero to print allocation counts after batch and served runs
+  FILE* result_fp; // if not NULL, where a halting run writes its result instead of appending it to out
+};
+
+// State shared between run() and the thread advancing the reference engine
+// during a cross-check. The two threads meet at a barrier before and after
+// every interval, so the reference engine only ever runs concurrently with
+// the engine being checked, never with the comparison.
+struct cross_check {
+  const struct engine* engine; // reference engine
+  void* e;
+  pthread_t thread;
+  pthread_barrier_t start;
+  pthread_barrier_t done;
+  unsigned long long n; // steps in the current interval
+  enum status status; // of the reference engine in the current interval
+  int quit;
+  unsigned long long last_good_step;
+  struct snapshot snap; // reference configuration
+  struct snapshot other_snap; // configuration of the engine being checked
+};
+
+// Machine formats supported by --convert-from and --convert-to.
+enum tm_format { FORMAT_PENROSE, FORMAT_STANDARD, FORMAT_BBDB, FORMAT_BUNDLE };
+static const char* const tm_format_names[] = { "penrose", "standard", "bbdb", "bundle" };
+
+// Layout of a bundle file, which stores many compiled machines for fast
+// random access. All integers are in native byte order. The file starts with
+// a header, followed by the machine index, the machine indexes sorted by name,
+// the transition tables and the names.
+struct bundle_header {
+  char magic[8]; // BUNDLE_MAGIC
+  uint64_t machines_len;
+  uint64_t entries_offset; // array of machines_len struct bundle_entry
+  uint64_t by_name_offset; // array of machines_len uint64_t machine indexes
+};
+struct bundle_entry {
+  uint64_t table_offset; // array of 2 * states_len struct bundle_action
+  uint64_t name_offset;
+  uint32_t states_len;
+  uint32_t name_len;
+};
+struct bundle_action { // action0 and action1 of each state in turn
+  uint32_t next_state;
+  uint8_t value_to_write;
+  int8_t direction_to_move;
+  uint16_t reserved;
+};
+
+// A mapped bundle file.
+struct bundle {
+  const char* data;
+  size_t len;
+  const struct bundle_header* header;
+  const struct bundle_entry* entries;
+  const uint64_t* by_name;
+};
+
+// Tape corpus file: many initial tapes packed for batch runs. All integers are
+// in native byte order. The file starts with a header, followed by the tape
+// index and the tapes, one bit per cell with the first cell in the lowest bit,
+// each starting on a byte boundary.
+struct tape_corpus_header {
+  char magic[8];
+  uint64_t tapes_len;
+  uint64_t index_offset; // array of tapes_len struct tape_corpus_entry
+  uint64_t data_offset;
+};
+struct tape_corpus_entry {
+  uint64_t offset; // from data_offset
+  uint64_t len; // number of cells
+};
+
+// A mapped tape corpus file.
+struct tape_corpus {
+  const char* data;
+  size_t len;
+  const struct tape_corpus_header* header;
+  const struct tape_corpus_entry* entries;
+};
+
+// The NUMA nodes with CPUs this process may run on.
+#define MAX_NUMA_NODES 64
+struct numa_topology {
+  size_t nodes_len;
+  cpu_set_t cpus[MAX_NUMA_NODES]; // CPUs of each node
+};
+
+// A copy of a bundle in the memory of one NUMA node, made by the first
+// worker to need it there.
+struct bundle_replica {
+  pthread_mutex_t lock;
+  char* data;
+  struct bundle bundle;
+};
+
+// Per-node copies of a mapped bundle, so that workers on every node read
+// machines from local memory.
+struct bundle_replicas {
+  const struct bundle* bundle;
+  size_t replicas_len; // zero if there is a single node
+  struct bundle_replica* replicas;
+};
+
+// Options controlling a conversion between machine formats.
+struct convert_options {
+  enum tm_format from;
+  enum tm_format to;
+  const char* input;
+  const char* output; // NULL for standard output
+  size_t threads;
+  size_t db_states;
+};
+
+// A machine which could not be converted.
+struct convert_error {
+  size_t record; // index of the record within its chunk
+  char msg[256];
+};
+
+// A contiguous range of input records converted by one worker.
+struct convert_chunk {
+  const char* start;
+  size_t len;
+  size_t records; // number of records (including blank lines) in the chunk
+  size_t converted;
+  struct buffer out; // for bundles, the transition tables
+  struct buffer entries; // for bundles, a struct bundle_entry per machine
+  struct buffer names; // for bundles
+  struct convert_error* errors;
+  size_t errors_len;
+  size_t errors_cap;
+};
+
+// State shared by the conversion workers.
+struct conversion {
+  const struct convert_options* opts;
+  struct bundle bundle; // for bundle input
+  size_t record_len; // for fixed-width input formats
+  struct convert_chunk* chunks;
+  size_t chunks_len;
+  size_t next_chunk; // next chunk to claim
+};
+
+// A range of chunks of a batch run, claimed first by the workers of one NUMA
+// node and then by the others.
+struct batch_range {
+  size_t next_chunk; // next chunk to claim
+  size_t end;
+  char pad[48]; // keeps the counters of different nodes on different cache lines
+};
+
+// A machine being run by a batch worker that interleaves several.
+struct batch_lane {
+  size_t job; // index of the machine and tape
+  struct state* states;
+  size_t states_len;
+  void* e; // engine instance, or NULL if the lane is idle
+  unsigned long long steps;
+  struct buffer tape;
+};
+
+// State shared by the batch workers.
+struct batch {
+  const struct bundle* bundle;
+  struct bundle_replicas replicas;
+  const char* tape;
+  size_t tape_len;
+  const struct tape_corpus* corpus; // tapes to run each machine on instead of tape, if not NULL
+  size_t jobs_len; // machines times tapes
+  const struct run_options* opts;
+  size_t interleave; // machines each worker advances in turn
+  unsigned long long allocs; // summed over the workers' pools
+  unsigned long long reuses;
+  size_t chunks_len;
+  size_t ranges_len;
+  struct batch_range* ranges; // chunks of each NUMA node
+  struct buffer* outs; // output of each chunk
+};
+
+// Shared-memory job queue, laid out in a file in /dev/shm as a header, a
+// ring of free job slots, a ring of submitted job slots, the jobs, and then
+// a data area per job holding its tape and, once done, its result. Both
+// rings are bounded multi-producer multi-consumer queues of slot numbers
+// with a sequence number per cell. Waiters sleep on futexes: workers on
+// submitted, clients on the state of their job or on freed.
+struct shm_queue_header {
+  char magic[8]; // written last by the server
+  uint64_t slots_len; // a power of two
+  uint64_t slot_data_len;
+  uint64_t free_offset;
+  uint64_t submit_offset;
+  uint64_t jobs_offset;
+  uint64_t data_offset;
+  uint32_t stop; // set to ask the server to finish
+  uint32_t submitted; // bumped after each submission
+  uint32_t submit_waiters;
+  uint32_t freed; // bumped after each slot is freed
+  uint32_t free_waiters;
+};
+
+struct shm_ring {
+  uint64_t enqueue_pos;
+  char pad1[56];
+  uint64_t dequeue_pos;
+  char pad2[56];
+  struct { uint64_t seq; uint64_t slot; } cells[];
+};
+
+// States of a job slot.
+enum shm_job_state { JOB_FREE, JOB_SUBMITTED, JOB_DONE };
+
+// Outcomes of a job, as in --batch.
+enum shm_job_status { JOB_HALTED, JOB_MAX_STEPS, JOB_MAX_TAPE_LEN, JOB_INVALID };
+
+struct shm_job {
+  uint64_t machine; // index in the server's bundle
+  uint64_t max_steps;
+  uint64_t max_tape_len;
+  uint64_t tape_len; // the tape is at the start of the job's data, followed by a NUL
+  uint64_t result_len; // the result or error message replaces the tape
+  uint64_t steps;
+  uint32_t state; // enum shm_job_state
+  uint32_t status; // enum shm_job_status
+  uint32_t waiting; // non-zero while the client sleeps on state
+  uint32_t reserved;
+};
+
+// A mapped job queue. The server holds an exclusive lock on the file for as
+// long as it serves, so that clients can tell that it has exited.
+struct shm_queue {
+  const char* name; // in /dev/shm
+  char* base;
+  size_t len;
+  int fd;
+  struct shm_queue_header* header;
+  struct shm_ring* free;
+  struct shm_ring* submit;
+  struct shm_job* jobs;
+  char* data;
+};
+
+// State shared by the server's worker threads.
+struct server {
+  struct bundle_replicas* replicas; // of the bundle of machines
+  const struct shm_queue* q;
+  // The queue's geometry as the server set it up; clients can write the
+  // copies in the queue header.
+  size_t slots_len;
+  size_t slot_data_len;
+  const struct run_options* opts;
+  unsigned long long allocs; // summed over the workers' pools
+  unsigned long long reuses;
+};
+
+// A worker thread started by run_workers().
+struct worker {
+  pthread_t thread;
+  size_t ix;
+  size_t node; // NUMA node the worker is pinned to
+  void* arg; // shared by all workers
+};
+
+// Kinds of certificate.
+enum certificate_kind { CERTIFICATE_HALTS, CERTIFICATE_CYCLE, CERTIFICATE_ESCAPE };
+
+// A certificate being verified.
+struct certificate {
+  const char* file;
+  char* text; // contents of the file; configurations point into it
+  struct state* states;
+  size_t states_len;
+  const char* tape;
+  size_t tape_len;
+  enum certificate_kind kind;
+  unsigned long long halts; // CERTIFICATE_HALTS: number of steps
+  struct snapshot* configs; // CERTIFICATE_HALTS: recorded configurations
+  uint64_t* hashes; // hash recorded with each configuration
+  size_t configs_len;
+  size_t segments_verified;
+  unsigned long long a; // CERTIFICATE_CYCLE, CERTIFICATE_ESCAPE: step of the witness
+  unsigned long long p; // CERTIFICATE_CYCLE: period
+  int direction; // CERTIFICATE_ESCAPE: direction of escape
+  char* escape; // CERTIFICATE_ESCAPE: flags of states in the escape set
+  int failed;
+  char reason[256];
+};
+
+// A unit of verification work: a segment of a halting certificate, or a
+// whole non-halting certificate.
+struct verify_task {
+  struct certificate* cert;
+  size_t segment;
+};
+
+// State shared by the verification workers.
+struct verification {
+  const struct verify_task* tasks;
+  size_t tasks_len;
+  size_t next_task; // next task to claim
+};
+
+// The states of a machine from which the head never moves left, compiled to
+// a finite-state transducer: each input cell is read once, in order, and
+// mapped to an output cell.
+struct transducer {
+  size_t states_len;
+  char* closed; // flags of the states from which the head never moves left
+  uint32_t* next; // next[2 * s + c]: state after state s reads c, or TRANSDUCER_HALT
+  char* write; // write[2 * s + c]: cell written when state s reads c
+};
+
+// A chunk of the input to a transducer. Chunks after the first are first
+// run speculatively from every state, so that all chunks can be processed in
+// parallel before it is known in which state each one starts.
+struct transducer_chunk {
+  const char* in;
+  size_t len;
+  char* out;
+  uint64_t* ends; // for each start state: the end state, or TRANSDUCER_HALTED | offset of the halt
+  uint32_t start; // start state, once resolved
+  uint64_t end; // end state or halt, once the chunk has been written
+};
+
+// State shared by the transducer workers.
+struct transduction {
+  const struct transducer* t;
+  struct transducer_chunk* chunks;
+  size_t chunks_len;
+  int speculate; // non-zero for the speculative pass, zero for the final pass
+  size_t next_chunk; // next chunk to claim
+};
+
 // Helper function signatures.
 void read_text_file(const char* f, const char** buffer);
 void parse_tm(const char* tm, struct state** states, size_t* states_len);
+int tm_parse(const char* tm, size_t tm_len, struct state** states, size_t* states_len,
+             char* err, size_t err_len);
+int link_action(struct state* states, size_t states_len, const struct state* state,
+                struct action* action, size_t next_state_ix, char* err, size_t err_len);
 void print_tm(const struct state* states, size_t states_len);
 void print_tm_action(size_t state_number, char c, const struct action* action);
-void run(const struct state* states, const char* initial_tape, size_t max_tape_len, unsigned long long max_steps, int verbosity);
+void run(const struct state* states, size_t states_len, const char* initial_tape, const struct run_options* opts);
+size_t check_tape(const char* tape);
+size_t parse_max_tape_len(const char* s);
+ssize_t find_result(const struct engine* engine, const void* e, const struct run_info* info, char* block,
+                    size_t block_len);
+void write_result(const struct engine* engine, const void* e, const struct run_info* info, FILE* fp);
+void append_result(const struct engine* engine, const void* e, const struct run_info* info, struct run_pool* pool,
+                   struct buffer* out);
+void handle_break(const struct engine* engine, const void* e, const struct run_options* opts, int watched);
+int write_checkpoint(const char* f, const struct engine* engine, const void* e);
+void take_checkpoint(struct checkpointer* cp, const struct engine* engine, const void* e);
+void finish_checkpoint(struct checkpointer* cp);
+int compare_ulls(const void* a, const void* b);
+uint64_t snapshot_hash(const struct snapshot* snap);
+void write_certificate_config(FILE* fp, const struct snapshot* snap);
+void begin_certificate(struct certificate_writer* cw, const struct state* states, const char* initial_tape);
+void end_certificate(struct certificate_writer* cw, const struct state* states, const char* initial_tape,
+                     size_t initial_tape_len, enum status status, const struct run_info* info);
+int find_nonhalting_witness(const struct state* states, size_t states_len, const char* initial_tape,
+                            size_t initial_tape_len, unsigned long long max_steps, struct buffer* out);
+void* reference_restore(const struct state* states, const struct snapshot* snap);
+int verify_certificates(const char* const* files, size_t files_len, size_t segments, size_t threads);
+enum status run_machine(const struct state* states, size_t states_len, const char* initial_tape,
+                        size_t initial_tape_len,
+                        const struct run_options* opts, struct run_info* info, struct buffer* out);
+const struct engine* find_engine(const char* name);
+void take_snapshot(const struct engine* engine, const void* e, struct snapshot* snap);
+int snapshots_equal(const struct snapshot* a, const struct snapshot* b);
+void print_snapshot(FILE* fp, const char* label, const struct snapshot* snap);
+void report_divergence(const struct state* states, const char* initial_tape,
+                       size_t initial_tape_len, size_t max_tape_len, const struct engine* engine,
+                       unsigned long long last_good_step);
+void cross_check_start(struct cross_check* cc, const struct state* states,
+                       const char* initial_tape, size_t initial_tape_len, size_t max_tape_len);
+void cross_check_begin(struct cross_check* cc, unsigned long long n);
+void cross_check_end(struct cross_check* cc, const struct state* states,
+                     const char* initial_tape, size_t initial_tape_len, size_t max_tape_len,
+                     const struct engine* engine, const void* e, enum status status);
+void cross_check_stop(struct cross_check* cc);
 void print_tape(const char* tape, int tape_len, int tape_ix, unsigned long long step, const struct state* state);
+size_t default_threads(void);
+void* pool_alloc(struct run_pool* pool, size_t len);
+void pool_free(struct run_pool* pool, void* p);
+void pool_count_alloc(struct run_pool* pool);
+void destroy_pool(struct run_pool* pool);
+void print_pool_stats(unsigned long long allocs, unsigned long long reuses);
+void read_numa_topology(struct numa_topology* topo);
+void run_workers(size_t n, void* (*fn)(void*), void* arg);
+void init_bundle_replicas(struct bundle_replicas* r, const struct bundle* bundle);
+const struct bundle* node_bundle(struct bundle_replicas* r, size_t node);
+void free_bundle_replicas(struct bundle_replicas* r);
+const char* map_file(const char* f, size_t* len);
+int find_tm_format(const char* name, enum tm_format* format);
+int decode_standard(const char* rec, size_t len, struct state** states, size_t* states_len,
+                    char* err, size_t err_len);
+int decode_bbdb(const unsigned char* rec, size_t db_states, struct state** states, size_t* states_len,
+                char* err, size_t err_len);
+int encode_penrose(const struct state* states, size_t states_len, struct buffer* out, char* err, size_t err_len);
+int encode_standard(const struct state* states, size_t states_len, struct buffer* out, char* err, size_t err_len);
+int encode_bbdb(const struct state* states, size_t states_len, size_t db_states, struct buffer* out,
+                char* err, size_t err_len);
+int convert(const struct convert_options* opts);
+void encode_bundle_table(const struct state* states, size_t states_len, struct buffer* out);
+void write_bundle(FILE* fp, const struct conversion* c, size_t machines);
+void open_bundle(const char* f, struct bundle* b);
+const char* bundle_name(const struct bundle* b, size_t ix, size_t* name_len);
+size_t bundle_find(const struct bundle* b, const char* name);
+int bundle_load(const struct bundle* b, size_t ix, struct run_pool* pool, struct state** states,
+                size_t* states_len, char* err, size_t err_len);
+int pack_tapes(const char* input, const char* output);
+int unpack_tapes(const char* input, const char* output);
+void open_tape_corpus(const char* f, struct tape_corpus* c);
+ssize_t corpus_tape(const struct tape_corpus* c, size_t ix, struct buffer* out);
+int run_batch(const struct bundle* bundle, const char* tape, const struct tape_corpus* corpus,
+              const struct run_options* opts, size_t threads, size_t interleave);
+int serve_jobs(const struct bundle* bundle, const char* name, const struct run_options* opts, size_t threads,
+               size_t slots_len, size_t slot_data_len);
+int submit_jobs(const char* name, const struct tape_corpus* corpus, unsigned long long max_steps,
+                unsigned long long max_tape_len);
+int stop_server(const char* name);
+void compile_transducer(const struct state* states, size_t states_len, struct transducer* t);
+void free_transducer(struct transducer* t);
+enum status stream_result(const struct state* states, const struct transducer* t, const struct engine* engine,
+                          void* e, const struct run_options* opts, struct run_info* info);
+uint64_t transduce(const struct transducer* t, uint32_t start, const char* in, size_t len, char* out);
+void transducer_speculate(const struct transducer* t, const char* in, size_t len, uint64_t* ends);
+int run_transducer(const struct state* states, size_t states_len, const char* initial_tape,
+                   size_t initial_tape_len, const struct run_options* opts);
 
 // Default constants.
 static const char* const DEFAULT_MAX_TAPE_LEN = "1048576"; // 2^20
 static const char* const DEFAULT_MAX_STEPS = "1048576"; // 2^20
+static const size_t DEFAULT_DB_STATES = 5;
+static const unsigned long long DEFAULT_CERTIFICATE_INTERVAL = 65536;
+static const size_t CONVERT_MIN_CHUNK_LEN = 1 << 16;
+static const size_t BATCH_CHUNK_LEN = 64;
+static const unsigned long long INTERLEAVE_SLICE = 256;
+static const uint32_t TRANSDUCER_HALT = (uint32_t) -1;
+static const uint64_t TRANSDUCER_HALTED = (uint64_t) 1 << 63;
+static const size_t TRANSDUCER_MIN_CHUNK_LEN = 1 << 20;
+static const size_t TRANSDUCER_MERGE_INTERVAL = 64;
+static const size_t STREAM_BLOCK_LEN = 1 << 16;
+static const size_t POOL_HEADER_LEN = 16; // keeps blocks aligned for any type
+static const size_t DEFAULT_SHM_SLOTS = 64;
+static const size_t DEFAULT_SHM_SLOT_DATA_LEN = 1 << 20;
+static const long SHM_LIVENESS_INTERVAL_NS = 200000000; // between checks that the server is alive
+static const uint32_t BUNDLE_UNNAMED = (uint32_t) -1;
+#define BBDB_HEADER_LEN 30
+#define BUNDLE_MAGIC "PTBUNDL1"
+#define SHM_MAGIC "PTQUEUE1"
+#define TAPE_CORPUS_MAGIC "PTTAPES1"
 
 int main(const int argc, char *argv[]) {
   struct arguments args = {0};
@@ -128,6 +969,65 @@ int main(const int argc, char *argv[]) {
   args.max_steps_str = DEFAULT_MAX_STEPS;
   argp_parse(&argp, argc, argv, 0, 0, &args);
 
+  const size_t threads = args.threads_str ? (size_t) strtoull(args.threads_str, NULL, 10) : default_threads();
+  if (threads == 0) {
+    fprintf(stderr, "Number of threads must be a positive integer; was %s.\n", args.threads_str);
+    exit(1);
+  }
+
+  if (args.convert_from || args.convert_to) {
+    struct convert_options copts = {0};
+    if (!args.convert_from || find_tm_format(args.convert_from, &(copts.from)) != 0
+        || !args.convert_to || find_tm_format(args.convert_to, &(copts.to)) != 0) {
+      fputs("Conversion requires --convert-from and --convert-to, each one of penrose, standard, bbdb or bundle.\n", stderr);
+      exit(1);
+    }
+    if (!args.input) {
+      fputs("Conversion requires --input.\n", stderr);
+      exit(1);
+    }
+    copts.input = args.input;
+    copts.output = args.output;
+    copts.threads = threads;
+    copts.db_states = args.db_states_str ? (size_t) strtoull(args.db_states_str, NULL, 10) : DEFAULT_DB_STATES;
+    if (copts.db_states == 0 || copts.db_states > 255) {
+      fprintf(stderr, "Number of seed-database states must be between 1 and 255; was %s.\n", args.db_states_str);
+      exit(1);
+    }
+    return convert(&copts);
+  }
+
+  if (args.verify) {
+    const size_t segments = args.verify_segments_str ? (size_t) strtoull(args.verify_segments_str, NULL, 10) : 0;
+    if (args.files.len == 0) {
+      fputs("--verify requires certificate files.\n", stderr);
+      exit(1);
+    }
+    return verify_certificates((const char* const *) args.files.data, args.files.len / sizeof(const char*),
+                               segments, threads);
+  }
+
+  if (args.pack_tapes || args.unpack_tapes) {
+    if (!args.input) {
+      fputs("Packing or unpacking tapes requires --input.\n", stderr);
+      exit(1);
+    }
+    return args.pack_tapes ? pack_tapes(args.input, args.output) : unpack_tapes(args.input, args.output);
+  }
+
+  struct tape_corpus corpus = {0};
+  if (args.tape_corpus) {
+    open_tape_corpus(args.tape_corpus, &corpus);
+  }
+
+  if (args.submit) {
+    return submit_jobs(args.submit, args.tape_corpus ? &corpus : NULL, strtoull(args.max_steps_str, NULL, 10),
+                       parse_max_tape_len(args.max_tape_len_str));
+  }
+  if (args.stop_server) {
+    return stop_server(args.stop_server);
+  }
+
   if (args.tm_file) {
     read_text_file(args.tm_file, &(args.tm));
   }
@@ -135,17 +1035,56 @@ int main(const int argc, char *argv[]) {
     read_text_file(args.tape_file, &(args.tape));
   }
 
-  struct state* states;
-  size_t states_len;
-  parse_tm(args.tm, &states, &states_len);
+  struct bundle bundle = {0};
+  if (args.tm_bundle) {
+    open_bundle(args.tm_bundle, &bundle);
+  }
+  struct state* states = NULL;
+  size_t states_len = 0;
+  if (args.batch) {
+    if (!args.tm_bundle || (args.tape == NULL && !args.tape_corpus)) {
+      fputs("Batch mode requires --tm-bundle and a tape or --tape-corpus.\n", stderr);
+      exit(1);
+    }
+  } else if (args.serve) {
+    if (!args.tm_bundle) {
+      fputs("--serve requires --tm-bundle.\n", stderr);
+      exit(1);
+    }
+  } else if (args.tm_bundle) {
+    size_t ix = (size_t) -1;
+    if (args.tm_name) {
+      ix = bundle_find(&bundle, args.tm_name);
+    } else if (args.tm_id) {
+      char* end;
+      ix = (size_t) strtoull(args.tm_id, &end, 10);
+      if (*end != '\0') {
+        ix = (size_t) -1;
+      }
+    } else {
+      fputs("--tm-bundle requires --tm-id, --tm-name or --batch.\n", stderr);
+      exit(1);
+    }
+    if (ix >= bundle.header->machines_len) {
+      fprintf(stderr, "No machine %s in bundle %s.\n", args.tm_name ? args.tm_name : args.tm_id, args.tm_bundle);
+      exit(1);
+    }
+    char err[256];
+    if (bundle_load(&bundle, ix, NULL, &states, &states_len, err, sizeof(err)) != 0) {
+      fprintf(stderr, "%s\n", err);
+      exit(1);
+    }
+  } else {
+    parse_tm(args.tm, &states, &states_len);
+  }
 
   // If there is no tape, just print the Turing machine specification.
-  if (args.tape == NULL) {
+  if (args.tape == NULL && !args.serve && !args.batch) {
     print_tm(states, states_len);
     return 0;
   }
 
-  const size_t max_tape_len = (size_t) strtoull(args.max_tape_len_str, NULL, 10);
+  const size_t max_tape_len = parse_max_tape_len(args.max_tape_len_str);
   if (max_tape_len == 0) {
     fprintf(stderr, "Maximum tape length must be a positive integer; was %s.\n", args.max_tape_len_str);
     exit(1);
@@ -156,7 +1095,134 @@ int main(const int argc, char *argv[]) {
     exit(1);
   }
 
-  run(states, args.tape, max_tape_len, max_steps, args.verbosity);
+  struct run_options opts = {0};
+  struct breakpoints bp = {0};
+  if (args.break_states.len > 0 || args.break_cells.len > 0 || args.watched_cells.len > 0) {
+    if (args.break_states.len > 0) {
+      char* const flags = (char *) calloc(states_len, sizeof(char));
+      if (flags == NULL) {
+        fputs("Out of memory.\n", stderr);
+        exit(1);
+      }
+      const unsigned long long* const break_states = (const unsigned long long *) args.break_states.data;
+      for (size_t i = 0; i < args.break_states.len / sizeof(unsigned long long); ++i) {
+        if (break_states[i] >= states_len) {
+          fprintf(stderr, "Breakpoint on non-existent state %llX.\n", break_states[i]);
+          exit(1);
+        }
+        flags[break_states[i]] = 1;
+      }
+      bp.states = flags;
+    }
+    bp.cells = (const ssize_t *) args.break_cells.data;
+    bp.cells_len = args.break_cells.len / sizeof(ssize_t);
+    bp.watched_cells = (const ssize_t *) args.watched_cells.data;
+    bp.watched_cells_len = args.watched_cells.len / sizeof(ssize_t);
+    opts.breakpoints = &bp;
+  }
+  opts.break_steps = (const unsigned long long *) args.break_steps.data;
+  opts.break_steps_len = args.break_steps.len / sizeof(unsigned long long);
+  qsort(args.break_steps.data, opts.break_steps_len, sizeof(unsigned long long), compare_ulls);
+  opts.on_break = isatty(STDIN_FILENO) ? BREAK_PROMPT : BREAK_CONTINUE;
+  if (args.on_break) {
+    size_t i = 0;
+    while (i < sizeof(break_action_names) / sizeof(break_action_names[0])
+           && strcmp(break_action_names[i], args.on_break) != 0) {
+      ++i;
+    }
+    if (i == sizeof(break_action_names) / sizeof(break_action_names[0])) {
+      fprintf(stderr, "Unknown breakpoint action %s.\n", args.on_break);
+      exit(1);
+    }
+    opts.on_break = (enum break_action) i;
+  }
+  opts.checkpoint = args.checkpoint;
+  if ((opts.breakpoints != NULL || opts.break_steps_len > 0) && (args.cross_check_str || args.batch || args.serve)) {
+    fputs("Breakpoints cannot be combined with --cross-check, --batch or --serve.\n", stderr);
+    exit(1);
+  }
+  struct certificate_writer cw = {0};
+  if (args.certificate) {
+    if (args.batch || args.serve) {
+      fputs("--certificate cannot be combined with --batch or --serve.\n", stderr);
+      exit(1);
+    }
+    cw.path = args.certificate;
+    cw.states_len = states_len;
+    cw.interval = args.certificate_interval_str ? strtoull(args.certificate_interval_str, NULL, 10)
+                                                : DEFAULT_CERTIFICATE_INTERVAL;
+    if (cw.interval == 0) {
+      fprintf(stderr, "Certificate interval must be a positive integer; was %s.\n", args.certificate_interval_str);
+      exit(1);
+    }
+    opts.certificate = &cw;
+  }
+  struct checkpointer cp = {0};
+  if (args.checkpoint_interval_str) {
+    if (!args.checkpoint || args.batch || args.serve) {
+      fputs("--checkpoint-interval requires --checkpoint and cannot be combined with --batch or --serve.\n", stderr);
+      exit(1);
+    }
+    cp.path = args.checkpoint;
+    cp.sync = args.checkpoint_sync;
+    cp.interval = strtoull(args.checkpoint_interval_str, NULL, 10);
+    if (cp.interval == 0) {
+      fprintf(stderr, "Checkpoint interval must be a positive integer; was %s.\n", args.checkpoint_interval_str);
+      exit(1);
+    }
+    opts.checkpointer = &cp;
+  }
+  if (args.stream_output) {
+    if (opts.breakpoints != NULL || opts.break_steps_len > 0 || args.cross_check_str || args.batch
+        || args.serve || opts.certificate != NULL) {
+      fputs("--stream-output cannot be combined with breakpoints, --cross-check, --batch, --serve or --certificate.\n",
+            stderr);
+      exit(1);
+    }
+    opts.stream_output = 1;
+  }
+  opts.max_tape_len = max_tape_len;
+  opts.max_steps = max_steps;
+  opts.verbosity = args.verbosity;
+  opts.stats = args.stats;
+  opts.engine = find_engine(args.engine ? args.engine : "flat");
+  if (opts.engine == NULL) {
+    fprintf(stderr, "Unknown engine %s.\n", args.engine);
+    exit(1);
+  }
+  if (args.cross_check_str) {
+    opts.cross_check_interval = strtoull(args.cross_check_str, NULL, 10);
+    if (opts.cross_check_interval == 0) {
+      fprintf(stderr, "Cross-check interval must be a positive integer; was %s.\n", args.cross_check_str);
+      exit(1);
+    }
+  }
+
+  if (args.batch) {
+    const size_t interleave = args.interleave_str ? (size_t) strtoull(args.interleave_str, NULL, 10) : 1;
+    if (interleave == 0 || (interleave > 1 && args.cross_check_str)) {
+      fputs("--interleave must be a positive integer and cannot be combined with --cross-check.\n", stderr);
+      exit(1);
+    }
+    return run_batch(&bundle, args.tape, args.tape_corpus ? &corpus : NULL, &opts, threads, interleave);
+  }
+  if (args.serve) {
+    const size_t slots_len = args.queue_slots_str ? (size_t) strtoull(args.queue_slots_str, NULL, 10)
+                                                  : DEFAULT_SHM_SLOTS;
+    const size_t slot_data_len = args.queue_slot_size_str ? (size_t) strtoull(args.queue_slot_size_str, NULL, 10)
+                                                          : DEFAULT_SHM_SLOT_DATA_LEN;
+    if (slots_len == 0 || (slots_len & (slots_len - 1)) != 0 || slot_data_len < 2) {
+      fputs("Number of queue slots must be a power of two and the slot size at least 2.\n", stderr);
+      exit(1);
+    }
+    return serve_jobs(&bundle, args.serve, &opts, threads, slots_len, slot_data_len);
+  }
+  // Runs that need nothing from a particular engine may take the
+  // transducer shortcut.
+  opts.streaming = !args.engine && !args.cross_check_str && opts.breakpoints == NULL
+                   && opts.break_steps_len == 0 && opts.certificate == NULL && opts.checkpointer == NULL;
+  opts.threads = threads;
+  run(states, states_len, args.tape, &opts);
 
   return 0;
 }
@@ -190,7 +1256,8 @@ void read_text_file(const char* const f, const char** buffer) {
 }
 
 /**
- * Parses the Turing machine specification.
+ * Parses the Turing machine specification, exiting with an error message if
+ * it is invalid.
  *
  * Parameters
  * ----------
@@ -202,19 +1269,45 @@ void read_text_file(const char* const f, const char** buffer) {
  * states_len - length of array of states
  */
 void parse_tm(const char* const tm, struct state** states, size_t* states_len) {
+  char err[256];
+  if (tm_parse(tm, strlen(tm), states, states_len, err, sizeof(err)) != 0) {
+    fprintf(stderr, "%s\n", err);
+    exit(1);
+  }
+}
+
+/**
+ * Parses the Turing machine specification.
+ *
+ * Parameters
+ * ----------
+ * tm      - Turing machine specification (need not be NUL-terminated)
+ * tm_len  - length of the specification
+ * err_len - size of the error message buffer
+ *
+ * "Out" Parameters
+ * ----------------
+ * states     - pointer to the array of states (memory allocated by this function)
+ * states_len - length of array of states
+ * err        - error message, if the specification is invalid
+ *
+ * Returns
+ * -------
+ * 0 on success, -1 if the specification is invalid
+ */
+int tm_parse(const char* const tm, const size_t tm_len, struct state** states, size_t* states_len,
+             char* const err, const size_t err_len) {
   // Add implicit "110" at beginning and end of specification.
   // Also check that the specification consists of only '0's and '1's.
-  size_t tm_len = 0;
-  for (const char* s = tm; *s != '\0'; ++s) {
-    if (*s != '0' && *s != '1') {
-      fprintf(stderr, "Invalid Turing machine specification at index %zu; "
-                      "encoding must consist of 0s and 1s only.\n", tm_len);
-      exit(1);
+  for (size_t i = 0; i < tm_len; ++i) {
+    if (tm[i] != '0' && tm[i] != '1') {
+      snprintf(err, err_len, "Invalid Turing machine specification at index %zu; "
+                             "encoding must consist of 0s and 1s only.", i);
+      return -1;
     }
-    ++tm_len;
   }
-  tm_len += 6;
-  char* const tm_tmp = (char *) calloc(tm_len + 1, sizeof(char));
+  const size_t tmp_len = tm_len + 6;
+  char* const tm_tmp = (char *) calloc(tmp_len + 1, sizeof(char));
   if (tm_tmp == NULL) {
     fputs("Out of memory.\n", stderr);
     exit(1);
@@ -222,16 +1315,14 @@ void parse_tm(const char* const tm, struct state** states, size_t* states_len) {
   tm_tmp[0] = '1';
   tm_tmp[1] = '1';
   tm_tmp[2] = '0';
-  for (size_t i = 3; i < tm_len - 3; ++i) {
-    tm_tmp[i] = tm[i - 3];
-  }
-  tm_tmp[tm_len - 3] = '1';
-  tm_tmp[tm_len - 2] = '1';
-  tm_tmp[tm_len - 1] = '0';
+  memcpy(tm_tmp + 3, tm, tm_len);
+  tm_tmp[tmp_len - 3] = '1';
+  tm_tmp[tmp_len - 2] = '1';
+  tm_tmp[tmp_len - 1] = '0';
 
   // Tokenize.
   size_t tokens_len = 0;
-  for (size_t i = 0; i < tm_len; ++i) {
+  for (size_t i = 0; i < tmp_len; ++i) {
     if (tm_tmp[i] == '0') {
       ++tokens_len;
     }
@@ -243,12 +1334,14 @@ void parse_tm(const char* const tm, struct state** states, size_t* states_len) {
   }
   size_t token_ix = 0;
   short token_len = 0;
-  for (size_t i = 0; i < tm_len; ++i) {
+  for (size_t i = 0; i < tmp_len; ++i) {
     ++token_len;
     if (token_len > 5) {
-      fprintf(stderr, "Invalid Turing machine specification at index %zu; "
-                      "specification contains more than four '1's.\n", i);
-      exit(1);
+      snprintf(err, err_len, "Invalid Turing machine specification at index %zu; "
+                             "specification contains more than four '1's.", i);
+      free(tm_tmp);
+      free(tokens);
+      return -1;
     }
     if (tm_tmp[i] == '0') {
       tokens[token_ix++] = (enum token) (token_len - 1);
@@ -265,15 +1358,19 @@ void parse_tm(const char* const tm, struct state** states, size_t* states_len) {
     }
   }
   if (actions_len % 2 != 0) {
-    fputs("Invalid Turing machine specification; "
-          "every state must define what to do after reading either a '0' or a '1'.",
-          stderr);
-    exit(1);
+    snprintf(err, err_len, "Invalid Turing machine specification; "
+                           "every state must define what to do after reading either a '0' or a '1'.");
+    free(tokens);
+    return -1;
   }
   *states_len = actions_len / 2;
 
   // Create the Turing machine states.
   *states = (struct state *) calloc(*states_len, sizeof(struct state));
+  if (*states == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
   size_t action_ix = 0;
   size_t state_ix = 0;
   enum token* token_start = tokens;
@@ -309,12 +1406,11 @@ void parse_tm(const char* const tm, struct state** states, size_t* states_len) {
       for (enum token* t = tokens + i - 2; t >= token_start; --t) {
         next_state_ix += ((unsigned int) (*t)) * 1u << j++;
       }
-      if (next_state_ix > *states_len - 1) {
-        fprintf(stderr, "Invalid Turing machine specification; "
-                        "state %zX has a transition to non-existent state %zX.", state->number, next_state_ix);
-        exit(1);
+      if (link_action(*states, *states_len, state, action, next_state_ix, err, err_len) != 0) {
+        free(tokens);
+        free(*states);
+        return -1;
       }
-      action->next_state = *states + next_state_ix;
     }
 
     // Update for next iteration.
@@ -325,18 +1421,53 @@ void parse_tm(const char* const tm, struct state** states, size_t* states_len) {
     token_start = tokens + i + 1;
   }
   free(tokens);
+  return 0;
 }
 
 /**
- * Prints a Turing machine specification.
+ * Sets the next state of an action, checking that the state exists. This is
+ * shared by the parser and the importers of other machine formats so that
+ * they validate transitions identically.
  *
  * Parameters
  * ----------
- * states     - array of states
- * states_len - length of array of states
+ * states        - array of states
+ * states_len    - length of array of states
+ * state         - state to which the action belongs
+ * next_state_ix - index of the next state
+ * err_len       - size of the error message buffer
+ *
+ * "Out" Parameters
+ * ----------------
+ * action - action whose next state is set
+ * err    - error message, if the next state does not exist
+ *
+ * Returns
+ * -------
+ * 0 on success, -1 if the next state does not exist
  */
-void print_tm(const struct state* const states, const size_t states_len) {
-  for (size_t i = 0; i < states_len; ++i) {
+int link_action(struct state* const states, const size_t states_len, const struct state* const state,
+                struct action* const action, const size_t next_state_ix,
+                char* const err, const size_t err_len) {
+  if (next_state_ix > states_len - 1) {
+    snprintf(err, err_len, "Invalid Turing machine specification; "
+                           "state %zX has a transition to non-existent state %zX.", state->number, next_state_ix);
+    return -1;
+  }
+  action->next_state = states + next_state_ix;
+  return 0;
+}
+
+/**
+ * Prints a Turing machine specification.
+ *
+ * Parameters
+ * ----------
+ * states     - array of states
+ * states_len - length of array of states
+ */
+void print_tm(const struct state* const states, const size_t states_len) {
+  for (size_t i = 0; i < states_len; ++i) {
     const struct state* const s = states + i;
     print_tm_action(s->number, '0', &(s->action0));
     print_tm_action(s->number, '1', &(s->action1));
@@ -366,107 +1497,62 @@ void print_tm_action(const size_t state_number, const char c, const struct actio
 }
 
 /**
- * Runs a Turing machine.
+ * Runs a Turing machine, printing the result or, for verbosity levels above
+ * zero, every step.
  *
  * Parameters
  * ----------
  * states       - Turing machine states
+ * states_len   - length of array of states
  * initial_tape - initial tape
- * max_tape_len - maximum tape length allowed
- * max_steps    - maximum number of steps allowed
- * verbosity    - verbosity level between 0 and 2
- */
-void run(const struct state* const states, const char* const initial_tape,
-         const size_t max_tape_len, const unsigned long long max_steps,
-         const int verbosity) {
-  size_t initial_tape_len = 0;
-  for (const char* s = initial_tape; *s != '\0'; ++s) {
-    if (*s != '0' && *s != '1') {
-      fprintf(stderr, "Invalid tape at index %zu; "
-                      "must consist of 0s and 1s only.\n", initial_tape_len);
-      exit(1);
-    }
-    ++initial_tape_len;
+ * opts         - run options
+ */
+void run(const struct state* const states, const size_t states_len, const char* const initial_tape,
+         const struct run_options* const opts) {
+  const size_t initial_tape_len = check_tape(initial_tape);
+  if (opts->streaming && opts->verbosity == 0
+      && run_transducer(states, states_len, initial_tape, initial_tape_len, opts)) {
+    return;
   }
-  char* tape = (char *) calloc(initial_tape_len + 1, sizeof(char));
-  strcpy(tape, initial_tape);
-  size_t tape_len = initial_tape_len;
 
   // First execution figures out how much tape is used.
-  size_t tape_expansion_amt = 1024;
-  const struct state* curr_state = states; // start in state zero
-  ssize_t tape_ix = 0;
-  ssize_t rel_tape_ix = 0;
-  ssize_t min_rel_tape_ix = 0;
-  ssize_t max_rel_tape_ix = tape_len - 1;
-  unsigned long long step = 0;
-  while(1) {
-    if (step == max_steps) {
-      fprintf(stderr, "Exceeded maximum number of steps (%llu).\n", max_steps);
-      exit(1);
-    }
-    ++step;
-    if (tape_len > max_tape_len) {
-      fprintf(stderr, "Exceeded maximum length of working tape (%zu).\n", max_tape_len);
-      exit(1);
-    }
-    struct action action;
-    if (tape[tape_ix] == '0' || tape[tape_ix] == ' ') {
-      action = curr_state->action0;
-    } else {
-      action = curr_state->action1;
-    }
-    tape[tape_ix] = action.value_to_write == 0 ? '0' : '1';
-    if (action.direction_to_move == 0) {
-      break;
-    }
-    tape_ix += action.direction_to_move;
-    rel_tape_ix += action.direction_to_move;
-    if (rel_tape_ix < min_rel_tape_ix) {
-      min_rel_tape_ix = rel_tape_ix;
-    }
-    if (rel_tape_ix > max_rel_tape_ix) {
-      max_rel_tape_ix = rel_tape_ix;
-    }
-    if (tape_ix < 0 || tape_ix == tape_len) { // Expand the tape.
-      char* const tape_tmp = (char *) calloc(tape_len + tape_expansion_amt + 1, sizeof(char));
-      if (tape_ix < 0) {
-        for (size_t i = 0; i < tape_expansion_amt; ++i) {
-          tape_tmp[i] = ' '; // last blank will be overwritten in next iteration
-        }
-        strcpy(tape_tmp + tape_expansion_amt, tape);
-        tape_ix += tape_expansion_amt;
-      } else {
-        strcpy(tape_tmp, tape);
-        for (size_t i = 0; i < tape_expansion_amt; ++i) {
-          tape_tmp[tape_len + i] = ' '; // first blank will be overwritten in next iteration
-        }
-        tape_tmp[tape_len + tape_expansion_amt] = '\0';
-      }
-      tape_len += tape_expansion_amt;
-      tape_expansion_amt *= 2;
-      free(tape);
-      tape = tape_tmp;
-    }
-    curr_state = action.next_state;
+  struct run_info info;
+  struct buffer out = {0};
+  if (opts->certificate != NULL) {
+    begin_certificate(opts->certificate, states, initial_tape);
   }
-
-  if (verbosity == 0) {
-    tape[tape_ix + 1] = '\0';
-    const char* s = tape + tape_ix;
-    while (*s != ' ' && s >= tape) {
-      --s;
-    }
-    fputs(++s, stdout);
+  // The result is written as it is read from the engine rather than
+  // collected, since with the disk engine it may not fit in memory.
+  struct run_options result_opts = *opts;
+  result_opts.result_fp = stdout;
+  const enum status status = run_machine(states, states_len, initial_tape, initial_tape_len, &result_opts, &info,
+                                         opts->verbosity == 0 ? &out : NULL);
+  if (opts->certificate != NULL) {
+    end_certificate(opts->certificate, states, initial_tape, initial_tape_len, status, &info);
+  }
+  if (status == RUNNING) {
+    fprintf(stderr, "Exceeded maximum number of steps (%llu).\n", opts->max_steps);
+    exit(1);
+  }
+  if (status == TAPE_LIMIT) {
+    fprintf(stderr, "Exceeded maximum length of working tape (%zu).\n", opts->max_tape_len);
+    exit(1);
+  }
+  if (opts->verbosity == 0) {
+    fwrite(out.data, 1, out.len, stdout);
     putchar('\n');
+    free(out.data);
     return;
   }
 
   // Second execution if we need verbosity.
-  size_t final_tape_len = max_rel_tape_ix - min_rel_tape_ix + 1;
-  tape_ix = -min_rel_tape_ix;
-  free(tape);
-  tape = (char *) calloc(final_tape_len + 1, sizeof(char));
+  size_t final_tape_len = info.max_pos - info.min_pos + 1;
+  ssize_t tape_ix = -info.min_pos;
+  char* const tape = (char *) calloc(final_tape_len + 1, sizeof(char));
+  if (tape == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
   for (size_t i = 0; i < final_tape_len; ++i) {
     tape[i] = ' ';
   }
@@ -475,8 +1561,8 @@ void run(const struct state* const states, const char* const initial_tape,
   }
   tape[final_tape_len] = '\0';
 
-  step = 0;
-  curr_state = states;
+  unsigned long long step = 0;
+  const struct state* curr_state = states;
   print_tape(tape, final_tape_len, tape_ix, step, curr_state);
   while(1) {
     ++step;
@@ -489,7 +1575,7 @@ void run(const struct state* const states, const char* const initial_tape,
     }
     char value_to_write = action.value_to_write == 0 ? '0' : '1';
     tape[tape_ix] = value_to_write;
-    if (verbosity == 2 || value_to_write != curr_value) {
+    if (opts->verbosity == 2 || value_to_write != curr_value) {
       print_tape(tape, final_tape_len, tape_ix, step, curr_state);
     }
     if (action.direction_to_move == 0) {
@@ -498,41 +1584,5213 @@ void run(const struct state* const states, const char* const initial_tape,
     tape_ix += action.direction_to_move;
     curr_state = action.next_state;
   }
+  free(tape);
 }
 
 /**
- * Prints the contents of the tape to stdout.
+ * Checks that a tape consists of only '0's and '1's, exiting with an error
+ * message if it does not.
  *
  * Parameters
  * ----------
- * tape     - tape string of ' 's, '0's, and '1's
- * tape_len - tape string length
- * tape_ix  - index in tape string of current cell
- * step     - step number of Turing machine operation
- * state    - pointer to current state of Turing machine
+ * tape - tape
+ *
+ * Returns
+ * -------
+ * length of the tape
  */
-void print_tape(const char* const tape, const int tape_len, int tape_ix,
-                unsigned long long step, const struct state* const state) {
-  if (step >= 0) {
-    printf("%5llu ", step);
+size_t check_tape(const char* const tape) {
+  size_t tape_len = 0;
+  for (const char* s = tape; *s != '\0'; ++s) {
+    if (*s != '0' && *s != '1') {
+      fprintf(stderr, "Invalid tape at index %zu; "
+                      "must consist of 0s and 1s only.\n", tape_len);
+      exit(1);
+    }
+    ++tape_len;
+  }
+  return tape_len;
+}
+
+/**
+ * Parses a maximum tape length, where "none" means no limit.
+ *
+ * Returns
+ * -------
+ * the maximum tape length, SIZE_MAX for no limit, or zero if s is not a
+ * positive integer
+ */
+size_t parse_max_tape_len(const char* const s) {
+  return strcmp(s, "none") == 0 ? SIZE_MAX : (size_t) strtoull(s, NULL, 10);
+}
+
+/**
+ * Runs a Turing machine until it halts or exceeds a limit, without printing
+ * anything unless opts->stream_output is set.
+ *
+ * Parameters
+ * ----------
+ * states           - Turing machine states
+ * states_len       - length of array of states
+ * initial_tape     - initial tape
+ * initial_tape_len - initial tape length
+ * opts             - run options
+ *
+ * "Out" Parameters
+ * ----------------
+ * info - final position of the machine
+ * out  - if not NULL and the machine halts, the result (the cells from the
+ *        first blank left of the head up to the head) is appended to out,
+ *        unless opts->result_fp is set
+ *
+ * Returns
+ * -------
+ * HALTED, TAPE_LIMIT, or RUNNING if the maximum number of steps was exceeded
+ */
+enum status run_machine(const struct state* const states, const size_t states_len, const char* const initial_tape,
+                        const size_t initial_tape_len, const struct run_options* const opts,
+                        struct run_info* const info, struct buffer* const out) {
+  const struct engine* const engine = opts->engine;
+  void* const e = engine->create(states, initial_tape, initial_tape_len, opts->max_tape_len, opts->pool);
+  const unsigned long long interval = opts->cross_check_interval;
+  struct cross_check cc;
+  if (interval != 0) {
+    cross_check_start(&cc, states, initial_tape, initial_tape_len, opts->max_tape_len);
+  }
+  enum status status = RUNNING;
+  size_t break_step_ix = 0;
+  // Runs that stream their output look for states from which the head never
+  // moves left again.
+  struct transducer t;
+  const int streaming = opts->stream_output && out != NULL;
+  if (streaming) {
+    compile_transducer(states, states_len, &t);
+  }
+  engine->get_info(e, info);
+  if (opts->certificate != NULL) {
+    take_snapshot(engine, e, &(opts->certificate->snap));
+    write_certificate_config(opts->certificate->fp, &(opts->certificate->snap));
+  }
+  while (status == RUNNING && info->step < opts->max_steps) {
+    unsigned long long n = opts->max_steps - info->step;
+    if (interval != 0 && interval < n) {
+      n = interval;
+    }
+    // Stop exactly at the next step breakpoint.
+    while (break_step_ix < opts->break_steps_len && opts->break_steps[break_step_ix] <= info->step) {
+      ++break_step_ix;
+    }
+    if (break_step_ix < opts->break_steps_len && opts->break_steps[break_step_ix] - info->step < n) {
+      n = opts->break_steps[break_step_ix] - info->step;
+    }
+    if (streaming && n > STREAM_BLOCK_LEN) {
+      n = STREAM_BLOCK_LEN;
+    }
+    // Stop exactly at the next periodic checkpoint.
+    if (opts->checkpointer != NULL
+        && opts->checkpointer->interval - info->step % opts->checkpointer->interval < n) {
+      n = opts->checkpointer->interval - info->step % opts->checkpointer->interval;
+    }
+    // Stop exactly at the next certificate configuration.
+    if (opts->certificate != NULL && opts->certificate->interval - info->step % opts->certificate->interval < n) {
+      n = opts->certificate->interval - info->step % opts->certificate->interval;
+    }
+    if (interval != 0) {
+      cross_check_begin(&cc, n);
+    }
+    // Only runs with breakpoints pay for checking them.
+    status = opts->breakpoints != NULL ? engine->advance_watched(e, n, opts->breakpoints) : engine->advance(e, n);
+    if (interval != 0) {
+      cross_check_end(&cc, states, initial_tape, initial_tape_len, opts->max_tape_len, engine, e, status);
+    }
+    // A breakpoint hit by the halting step pauses the run before it ends.
+    if (status == BREAK && opts->breakpoints->halted) {
+      handle_break(engine, e, opts, 1);
+      status = HALTED;
+    }
+    engine->get_info(e, info);
+    if (opts->certificate != NULL && (status == HALTED || info->step % opts->certificate->interval == 0)) {
+      take_snapshot(engine, e, &(opts->certificate->snap));
+      write_certificate_config(opts->certificate->fp, &(opts->certificate->snap));
+    }
+    if (opts->checkpointer != NULL && status == RUNNING && info->step % opts->checkpointer->interval == 0) {
+      take_checkpoint(opts->checkpointer, engine, e);
+    }
+    if (streaming && status == RUNNING && t.closed[info->state->number]) {
+      if (opts->checkpointer != NULL) {
+        finish_checkpoint(opts->checkpointer);
+      }
+      status = stream_result(states, &t, engine, e, opts, info);
+      free_transducer(&t);
+      return status;
+    }
+    if (status == BREAK
+        || (status == RUNNING && break_step_ix < opts->break_steps_len && opts->break_steps[break_step_ix] == info->step)) {
+      handle_break(engine, e, opts, status == BREAK);
+      status = RUNNING;
+    }
+  }
+  if (interval != 0) {
+    cross_check_stop(&cc);
+  }
+
+  if (status == HALTED && out != NULL) {
+    if (opts->result_fp != NULL) {
+      write_result(engine, e, info, opts->result_fp);
+    } else {
+      append_result(engine, e, info, opts->pool, out);
+    }
+  }
+  if (streaming) {
+    free_transducer(&t);
+  }
+  if (opts->checkpointer != NULL) {
+    finish_checkpoint(opts->checkpointer);
+  }
+  engine->destroy(e);
+  return status;
+}
+
+/**
+ * Finds where the result of a halted machine, the cells from the first blank
+ * left of the head up to the head, starts. The cells are read back from the
+ * head a block at a time, so the span left of the result is never held in
+ * memory.
+ *
+ * Parameters
+ * ----------
+ * engine    - engine
+ * e         - engine instance
+ * info      - final position of the machine
+ * block_len - length of block, at most the number of cells from info->min_pos
+ *             to the head
+ *
+ * "Out" Parameters
+ * ----------------
+ * block - the block_len cells up to the head
+ *
+ * Returns
+ * -------
+ * position of the first cell of the result
+ */
+ssize_t find_result(const struct engine* const engine, const void* const e, const struct run_info* const info,
+                    char* const block, const size_t block_len) {
+  ssize_t end = info->head + 1;
+  ssize_t begin = end - (ssize_t) block_len;
+  engine->read_cells(e, begin, block_len, block);
+  for (ssize_t pos = end - 1; pos >= begin; --pos) {
+    if (block[pos - begin] == ' ') {
+      return pos + 1;
+    }
+  }
+  // Look further left in another buffer, leaving the last block in place.
+  char* const more = (char *) malloc(block_len);
+  if (more == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  ssize_t first = info->min_pos;
+  for (end = begin; end > info->min_pos && first == info->min_pos; end = begin) {
+    begin = end - (ssize_t) block_len > info->min_pos ? end - (ssize_t) block_len : info->min_pos;
+    engine->read_cells(e, begin, end - begin, more);
+    for (ssize_t pos = end - 1; pos >= begin; --pos) {
+      if (more[pos - begin] == ' ') {
+        first = pos + 1;
+        break;
+      }
+    }
+  }
+  free(more);
+  return first;
+}
+
+/**
+ * Writes the result of a halted machine to a file a block at a time, so
+ * that a result longer than memory can be written from a disk-backed tape.
+ *
+ * Parameters
+ * ----------
+ * engine - engine
+ * e      - engine instance
+ * info   - final position of the machine
+ * fp     - file
+ */
+void write_result(const struct engine* const engine, const void* const e, const struct run_info* const info,
+                  FILE* const fp) {
+  const size_t cells_len = info->head - info->min_pos + 1;
+  const size_t block_len = cells_len < STREAM_BLOCK_LEN ? cells_len : STREAM_BLOCK_LEN;
+  char* const block = (char *) malloc(block_len);
+  if (block == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  const ssize_t first = find_result(engine, e, info, block, block_len);
+  const ssize_t block_first = info->head + 1 - (ssize_t) block_len;
+  if (first >= block_first) {
+    fwrite(block + (first - block_first), 1, info->head + 1 - first, fp);
   } else {
-    printf("      ");
+    for (ssize_t pos = first; pos <= info->head; pos += block_len) {
+      const size_t left = (size_t) (info->head + 1 - pos);
+      const size_t n = left < block_len ? left : block_len;
+      engine->read_cells(e, pos, n, block);
+      fwrite(block, 1, n, fp);
+    }
   }
-  if (state != NULL) {
-    printf("%5zX:", state->number);
+  free(block);
+}
+
+/**
+ * Appends the result of a halted machine to a buffer.
+ *
+ * Parameters
+ * ----------
+ * engine - engine
+ * e      - engine instance
+ * info   - final position of the machine
+ * pool   - memory of the calling worker, or NULL
+ *
+ * "Out" Parameters
+ * ----------------
+ * out - buffer
+ */
+void append_result(const struct engine* const engine, const void* const e, const struct run_info* const info,
+                   struct run_pool* const pool, struct buffer* const out) {
+  const size_t cells_len = info->head - info->min_pos + 1;
+  const size_t block_len = cells_len < STREAM_BLOCK_LEN ? cells_len : STREAM_BLOCK_LEN;
+  char* const block = (char *) pool_alloc(pool, block_len);
+  const ssize_t first = find_result(engine, e, info, block, block_len);
+  const ssize_t block_first = info->head + 1 - (ssize_t) block_len;
+  if (first >= block_first) {
+    buffer_append(out, block + (first - block_first), info->head + 1 - first);
   } else {
-    printf("   :");
+    for (ssize_t pos = first; pos <= info->head; pos += block_len) {
+      const size_t left = (size_t) (info->head + 1 - pos);
+      const size_t n = left < block_len ? left : block_len;
+      engine->read_cells(e, pos, n, block);
+      buffer_append(out, block, n);
+    }
   }
-  for (int i = 0; i < tape_ix; ++i) {
-    putchar(' ');
-    putchar(tape[i]);
+  pool_free(pool, block);
+}
+
+/**
+ * Pauses at a breakpoint: prints the configuration to stderr and then, as
+ * configured, continues, writes a checkpoint, quits, or asks which of these
+ * to do.
+ *
+ * Parameters
+ * ----------
+ * engine  - engine
+ * e       - engine instance
+ * opts    - run options
+ * watched - non-zero if the engine stopped on one of opts->breakpoints, zero
+ *           for a step breakpoint
+ */
+void handle_break(const struct engine* const engine, const void* const e,
+                  const struct run_options* const opts, const int watched) {
+  struct snapshot snap = {0};
+  take_snapshot(engine, e, &snap);
+  const struct breakpoints* const bp = opts->breakpoints;
+  if (!watched) {
+    fprintf(stderr, "Breakpoint: reached step %llu.\n", snap.info.step);
+  } else if (bp->hit == HIT_STATE) {
+    fprintf(stderr, "Breakpoint: entered state %zX.\n", snap.info.state->number);
+  } else if (bp->hit == HIT_CELL) {
+    fprintf(stderr, "Breakpoint: head reached cell %zd.\n", snap.info.head);
+  } else {
+    fprintf(stderr, "Watchpoint: cell %zd changed%s.\n", bp->hit_cell, bp->halted ? " as the machine halted" : "");
   }
-  putchar(step > 0 ? '|' : ' ');
-  putchar(tape[tape_ix]);
-  putchar(step > 0 ? '|' : ' ');
-  for (int i = tape_ix + 1; i < tape_len; ++i) {
-    putchar(tape[i]);
-    putchar(' ');
+  print_snapshot(stderr, "break", &snap);
+
+  enum break_action action = opts->on_break;
+  while (action == BREAK_PROMPT) {
+    fputs("[c]ontinue, [s]ave checkpoint and continue, or [q]uit? ", stderr);
+    char line[64];
+    if (fgets(line, sizeof(line), stdin) == NULL) {
+      action = BREAK_QUIT;
+    } else if (line[0] == 'c' || line[0] == '\n') {
+      action = BREAK_CONTINUE;
+    } else if (line[0] == 's') {
+      action = BREAK_CHECKPOINT;
+    } else if (line[0] == 'q') {
+      action = BREAK_QUIT;
+    }
   }
-  putchar('\n');
+  if (action == BREAK_CHECKPOINT) {
+    if (opts->checkpoint == NULL) {
+      fputs("No checkpoint file; use --checkpoint.\n", stderr);
+    } else if (write_checkpoint(opts->checkpoint, engine, e) != 0) {
+      exit(1);
+    } else {
+      fprintf(stderr, "Wrote checkpoint %s.\n", opts->checkpoint);
+    }
+  }
+  free(snap.cells);
+  if (action == BREAK_QUIT) {
+    exit(1);
+  }
+}
+
+/**
+ * Writes a configuration to a checkpoint file. The file is text: a version
+ * line followed by the step, the state number in hexadecimal, the head
+ * position, the position of the first cell, and the cells from the first
+ * to the last visited, with ' ' for blanks. It is written to a temporary
+ * file which then replaces f, so f always holds a complete checkpoint. The
+ * cells are copied from the engine a block at a time, so writing a
+ * checkpoint takes no more memory than a block whatever the length of the
+ * tape.
+ *
+ * Parameters
+ * ----------
+ * f      - file name
+ * engine - engine
+ * e      - engine instance
+ *
+ * Returns
+ * -------
+ * 0 on success, -1 after printing an error message
+ */
+int write_checkpoint(const char* const f, const struct engine* const engine, const void* const e) {
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", f);
+  FILE* const fp = fopen(tmp, "w");
+  char* const block = (char *) malloc(STREAM_BLOCK_LEN);
+  if (block == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  if (fp == NULL) {
+    fprintf(stderr, "Error opening file %s.\n", tmp);
+    free(block);
+    return -1;
+  }
+  struct run_info info;
+  engine->get_info(e, &info);
+  fprintf(fp, "penrose-turing checkpoint 1\nstep %llu\nstate %zX\nhead %zd\nfirst %zd\ntape ",
+          info.step, info.state->number, info.head, info.min_pos);
+  for (ssize_t pos = info.min_pos; pos <= info.max_pos; pos += STREAM_BLOCK_LEN) {
+    const size_t left = (size_t) (info.max_pos - pos + 1);
+    const size_t n = left < STREAM_BLOCK_LEN ? left : STREAM_BLOCK_LEN;
+    engine->read_cells(e, pos, n, block);
+    fwrite(block, 1, n, fp);
+  }
+  free(block);
+  fputc('\n', fp);
+  if (fclose(fp) != 0 || rename(tmp, f) != 0) {
+    fprintf(stderr, "Error writing file %s.\n", f);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Writes a periodic checkpoint. Unless cp->sync is set, the process forks
+ * and the child writes the checkpoint from its copy-on-write image of the
+ * tape while the parent continues stepping. At most one child exists at a
+ * time, which bounds how much memory the copies can take: while the previous
+ * child is still writing, the checkpoint is skipped rather than making the
+ * run wait, and the next one is taken at the following interval. If fork()
+ * fails, or the engine keeps part of the tape in a file that the parent
+ * would go on rewriting, the checkpoint is written synchronously.
+ *
+ * Parameters
+ * ----------
+ * cp     - checkpointer
+ * engine - engine
+ * e      - engine instance
+ */
+void take_checkpoint(struct checkpointer* const cp, const struct engine* const engine, const void* const e) {
+  if (cp->child != 0) {
+    int wstatus;
+    const pid_t pid = waitpid(cp->child, &wstatus, WNOHANG);
+    if (pid == 0 || (pid == -1 && errno == EINTR)) {
+      return; // still writing the last checkpoint
+    }
+    if (pid == -1) {
+      fputs("Error waiting for checkpoint process.\n", stderr);
+      exit(1);
+    }
+    cp->child = 0;
+    if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+      exit(1); // the child has printed the error
+    }
+  }
+  if (!cp->sync && engine->forkable) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+      // Leave the parent's buffered output and exit handlers alone.
+      _exit(write_checkpoint(cp->path, engine, e) == 0 ? 0 : 1);
+    }
+    if (pid > 0) {
+      cp->child = pid;
+      return;
+    }
+  }
+  if (write_checkpoint(cp->path, engine, e) != 0) {
+    exit(1);
+  }
+}
+
+/**
+ * Waits for the child writing the last checkpoint, if any, exiting if it
+ * failed.
+ *
+ * Parameters
+ * ----------
+ * cp - checkpointer
+ */
+void finish_checkpoint(struct checkpointer* const cp) {
+  if (cp->child == 0) {
+    return;
+  }
+  int wstatus;
+  while (waitpid(cp->child, &wstatus, 0) == -1) {
+    if (errno != EINTR) {
+      fputs("Error waiting for checkpoint process.\n", stderr);
+      exit(1);
+    }
+  }
+  cp->child = 0;
+  if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+    exit(1); // the child has printed the error
+  }
+}
+
+/**
+ * Checks whether the step just executed hits a breakpoint. A halting step
+ * enters no state and moves the head nowhere, so only watchpoints apply to
+ * it.
+ *
+ * Parameters
+ * ----------
+ * bp        - breakpoints
+ * state     - state entered
+ * head      - new head position
+ * direction - direction in which the head moved, 0 if the step halted
+ * changed   - non-zero if the step changed the value of the cell it wrote
+ *
+ * Returns
+ * -------
+ * non-zero if a breakpoint is hit
+ */
+static inline int breakpoint_hit(struct breakpoints* const bp, const struct state* const state,
+                                 const ssize_t head, const int direction, const int changed) {
+  bp->halted = direction == 0;
+  if (direction != 0 && bp->states != NULL && bp->states[state->number]) {
+    bp->hit = HIT_STATE;
+    return 1;
+  }
+  for (size_t i = 0; direction != 0 && i < bp->cells_len; ++i) {
+    if (bp->cells[i] == head) {
+      bp->hit = HIT_CELL;
+      return 1;
+    }
+  }
+  if (changed) {
+    for (size_t i = 0; i < bp->watched_cells_len; ++i) {
+      if (bp->watched_cells[i] == head - direction) {
+        bp->hit = HIT_WATCHED_CELL;
+        bp->hit_cell = head - direction;
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Flat engine: the tape is a single contiguous string which is reallocated
+// with geometrically increasing padding whenever the head runs off either end.
+struct flat_engine;
+typedef enum status (*flat_loop)(struct flat_engine* f, unsigned long long n, struct breakpoints* bp);
+struct flat_engine {
+  const flat_loop* loops; // the step loops for this engine's limit policy, unwatched and watched
+  struct run_pool* pool; // memory for the engine and its tape, or NULL
+  const struct state* curr_state;
+  char* tape; // string of ' 's, '0's, and '1's
+  size_t tape_len;
+  size_t tape_expansion_amt;
+  size_t max_tape_len;
+  ssize_t tape_ix;
+  ssize_t rel_tape_ix;
+  ssize_t min_rel_tape_ix;
+  ssize_t max_rel_tape_ix;
+  unsigned long long step;
+};
+
+static enum status flat_loop_unlimited(struct flat_engine* f, unsigned long long n, struct breakpoints* bp);
+static enum status flat_loop_unlimited_watched(struct flat_engine* f, unsigned long long n, struct breakpoints* bp);
+static enum status flat_loop_limited(struct flat_engine* f, unsigned long long n, struct breakpoints* bp);
+static enum status flat_loop_limited_watched(struct flat_engine* f, unsigned long long n, struct breakpoints* bp);
+
+// The step loops of the flat engine by limit policy (unlimited, limited) and
+// instrumentation (unwatched, watched), chosen when an engine is created.
+static const flat_loop flat_loops[2][2] = {
+  { flat_loop_unlimited, flat_loop_unlimited_watched },
+  { flat_loop_limited, flat_loop_limited_watched },
+};
+
+static void* flat_create(const struct state* const states, const char* const initial_tape,
+                         const size_t initial_tape_len, const size_t max_tape_len, struct run_pool* const pool) {
+  struct flat_engine* const f = (struct flat_engine *) pool_alloc(pool, sizeof(struct flat_engine));
+  memset(f, 0, sizeof(struct flat_engine));
+  // An empty initial tape is a single blank cell.
+  const size_t tape_len = initial_tape_len > 0 ? initial_tape_len : 1;
+  char* const tape = (char *) pool_alloc(pool, tape_len + 1);
+  memcpy(tape, initial_tape_len > 0 ? initial_tape : " ", tape_len);
+  tape[tape_len] = '\0';
+  f->pool = pool;
+  f->curr_state = states; // start in state zero
+  f->tape = tape;
+  f->tape_len = tape_len;
+  f->tape_expansion_amt = 1024;
+  f->loops = flat_loops[max_tape_len != SIZE_MAX];
+  f->max_tape_len = max_tape_len;
+  f->max_rel_tape_ix = tape_len - 1;
+  return f;
+}
+
+// The step loop of the flat engine. It is specialized for each combination of
+// policies: with bp NULL the breakpoint check compiles away, and without
+// limited so does the tape length check. As in every engine, the length of
+// the working tape is the span of cells visited or initially on the tape,
+// not the allocated buffer; it only grows when the head passes the cells
+// visited so far, so that is where the limit is checked. A run that exceeds
+// it stops before the next step, as if the check were made before every step.
+static inline __attribute__((always_inline))
+enum status flat_advance_impl(struct flat_engine* const f, const unsigned long long n,
+                              struct breakpoints* const bp, const int limited) {
+  const struct state* curr_state = f->curr_state;
+  char* tape = f->tape;
+  size_t tape_len = f->tape_len;
+  ssize_t tape_ix = f->tape_ix;
+  ssize_t rel_tape_ix = f->rel_tape_ix;
+  ssize_t min_rel_tape_ix = f->min_rel_tape_ix;
+  ssize_t max_rel_tape_ix = f->max_rel_tape_ix;
+  unsigned long long step = f->step;
+  enum status status = RUNNING;
+  if (limited && (size_t) (max_rel_tape_ix - min_rel_tape_ix + 1) > f->max_tape_len) {
+    return TAPE_LIMIT;
+  }
+  unsigned long long end = n;
+  for (unsigned long long i = 0; i < end; ++i) {
+    ++step;
+    struct action action;
+    const char curr_value = tape[tape_ix];
+    if (curr_value == '0' || curr_value == ' ') {
+      action = curr_state->action0;
+    } else {
+      action = curr_state->action1;
+    }
+    tape[tape_ix] = action.value_to_write == 0 ? '0' : '1';
+    if (action.direction_to_move == 0) {
+      status = bp != NULL && breakpoint_hit(bp, curr_state, rel_tape_ix, 0,
+                                            (curr_value == '1') != (action.value_to_write != 0)) ? BREAK : HALTED;
+      break;
+    }
+    tape_ix += action.direction_to_move;
+    rel_tape_ix += action.direction_to_move;
+    if (rel_tape_ix < min_rel_tape_ix || rel_tape_ix > max_rel_tape_ix) {
+      min_rel_tape_ix = rel_tape_ix < min_rel_tape_ix ? rel_tape_ix : min_rel_tape_ix;
+      max_rel_tape_ix = rel_tape_ix > max_rel_tape_ix ? rel_tape_ix : max_rel_tape_ix;
+      if (limited && (size_t) (max_rel_tape_ix - min_rel_tape_ix + 1) > f->max_tape_len) {
+        end = i + 1;
+      }
+    }
+    if (tape_ix < 0 || tape_ix == tape_len) { // Expand the tape.
+      const size_t tape_expansion_amt = f->tape_expansion_amt;
+      char* const tape_tmp = (char *) pool_alloc(f->pool, tape_len + tape_expansion_amt + 1);
+      if (tape_ix < 0) {
+        for (size_t i = 0; i < tape_expansion_amt; ++i) {
+          tape_tmp[i] = ' '; // last blank will be overwritten in next iteration
+        }
+        strcpy(tape_tmp + tape_expansion_amt, tape);
+        tape_ix += tape_expansion_amt;
+      } else {
+        strcpy(tape_tmp, tape);
+        for (size_t i = 0; i < tape_expansion_amt; ++i) {
+          tape_tmp[tape_len + i] = ' '; // first blank will be overwritten in next iteration
+        }
+        tape_tmp[tape_len + tape_expansion_amt] = '\0';
+      }
+      tape_len += tape_expansion_amt;
+      f->tape_expansion_amt *= 2;
+      pool_free(f->pool, tape);
+      tape = tape_tmp;
+    }
+    curr_state = action.next_state;
+    if (bp != NULL && breakpoint_hit(bp, curr_state, rel_tape_ix, action.direction_to_move,
+                                     (curr_value == '1') != (action.value_to_write != 0))) {
+      status = BREAK;
+      break;
+    }
+  }
+  f->curr_state = curr_state;
+  f->tape = tape;
+  f->tape_len = tape_len;
+  f->tape_ix = tape_ix;
+  f->rel_tape_ix = rel_tape_ix;
+  f->min_rel_tape_ix = min_rel_tape_ix;
+  f->max_rel_tape_ix = max_rel_tape_ix;
+  f->step = step;
+  return status == RUNNING && end < n ? TAPE_LIMIT : status;
+}
+
+static enum status flat_loop_unlimited(struct flat_engine* const f, const unsigned long long n,
+                                       struct breakpoints* const bp) {
+  (void) bp;
+  return flat_advance_impl(f, n, NULL, 0);
+}
+
+static enum status flat_loop_unlimited_watched(struct flat_engine* const f, const unsigned long long n,
+                                               struct breakpoints* const bp) {
+  return flat_advance_impl(f, n, bp, 0);
+}
+
+static enum status flat_loop_limited(struct flat_engine* const f, const unsigned long long n,
+                                     struct breakpoints* const bp) {
+  (void) bp;
+  return flat_advance_impl(f, n, NULL, 1);
+}
+
+static enum status flat_loop_limited_watched(struct flat_engine* const f, const unsigned long long n,
+                                             struct breakpoints* const bp) {
+  return flat_advance_impl(f, n, bp, 1);
+}
+
+static enum status flat_advance(void* const e, const unsigned long long n) {
+  struct flat_engine* const f = (struct flat_engine *) e;
+  return f->loops[0](f, n, NULL);
+}
+
+static enum status flat_advance_watched(void* const e, const unsigned long long n, struct breakpoints* const bp) {
+  struct flat_engine* const f = (struct flat_engine *) e;
+  return f->loops[1](f, n, bp);
+}
+
+static void flat_get_info(const void* const e, struct run_info* const info) {
+  const struct flat_engine* const f = (const struct flat_engine *) e;
+  info->step = f->step;
+  info->state = f->curr_state;
+  info->head = f->rel_tape_ix;
+  info->min_pos = f->min_rel_tape_ix;
+  info->max_pos = f->max_rel_tape_ix;
+}
+
+static void flat_read_cells(const void* const e, const ssize_t first, const size_t n, char* const out) {
+  const struct flat_engine* const f = (const struct flat_engine *) e;
+  const ssize_t origin = f->tape_ix - f->rel_tape_ix; // index in tape of position zero
+  for (size_t i = 0; i < n; ++i) {
+    const ssize_t ix = origin + first + (ssize_t) i;
+    out[i] = ix >= 0 && ix < (ssize_t) f->tape_len ? f->tape[ix] : ' ';
+  }
+}
+
+static void flat_prefetch(const void* const e, const size_t n) {
+  const struct flat_engine* const f = (const struct flat_engine *) e;
+  const ssize_t first = f->tape_ix > (ssize_t) n ? f->tape_ix - (ssize_t) n : 0;
+  const ssize_t last = f->tape_ix + (ssize_t) n < (ssize_t) f->tape_len ? f->tape_ix + (ssize_t) n
+                       : (ssize_t) f->tape_len - 1;
+  for (ssize_t ix = first; ix <= last; ix += 64) {
+    __builtin_prefetch(f->tape + ix, 1, 3);
+  }
+  __builtin_prefetch(f->tape + last, 1, 3);
+}
+
+static void flat_destroy(void* const e) {
+  struct flat_engine* const f = (struct flat_engine *) e;
+  struct run_pool* const pool = f->pool;
+  pool_free(pool, f->tape);
+  pool_free(pool, f);
+}
+
+// Reference engine: a deliberately naive implementation, sharing no code with
+// the other engines, against which they are validated. The tape is kept as
+// two arrays growing away from position zero, one for positions 0, 1, 2, ...
+// and one for positions -1, -2, -3, ...
+struct reference_engine {
+  const struct state* state;
+  char* cells[2];
+  size_t cells_len[2];
+  ssize_t head;
+  ssize_t min_pos;
+  ssize_t max_pos;
+  size_t max_tape_len;
+  unsigned long long step;
+  struct run_pool* pool; // only counts allocations
+};
+
+static char* reference_cell(struct reference_engine* const r, const ssize_t pos) {
+  const int side = pos < 0 ? 1 : 0;
+  const size_t i = pos < 0 ? (size_t) (-pos - 1) : (size_t) pos;
+  if (i >= r->cells_len[side]) {
+    const size_t len = 2 * (i + 1);
+    char* const cells = (char *) realloc(r->cells[side], len);
+    if (cells == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    pool_count_alloc(r->pool);
+    memset(cells + r->cells_len[side], ' ', len - r->cells_len[side]);
+    r->cells[side] = cells;
+    r->cells_len[side] = len;
+  }
+  return r->cells[side] + i;
+}
+
+static void* reference_create(const struct state* const states, const char* const initial_tape,
+                              const size_t initial_tape_len, const size_t max_tape_len,
+                              struct run_pool* const pool) {
+  // The reference engine stays as simple as possible, and takes nothing from
+  // the pool.
+  struct reference_engine* const r = (struct reference_engine *) calloc(1, sizeof(struct reference_engine));
+  if (r == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  pool_count_alloc(pool);
+  r->pool = pool;
+  r->state = states;
+  for (size_t i = 0; i < initial_tape_len; ++i) {
+    *reference_cell(r, i) = initial_tape[i];
+  }
+  r->max_pos = initial_tape_len > 0 ? initial_tape_len - 1 : 0;
+  r->max_tape_len = max_tape_len;
+  return r;
+}
+
+static enum status reference_advance_watched(void* const e, const unsigned long long n, struct breakpoints* const bp) {
+  struct reference_engine* const r = (struct reference_engine *) e;
+  for (unsigned long long i = 0; i < n; ++i) {
+    if ((size_t) (r->max_pos - r->min_pos + 1) > r->max_tape_len) {
+      return TAPE_LIMIT;
+    }
+    ++r->step;
+    char* const cell = reference_cell(r, r->head);
+    const struct action* const action = *cell == '1' ? &(r->state->action1) : &(r->state->action0);
+    const int changed = (*cell == '1') != (action->value_to_write != 0);
+    *cell = action->value_to_write == 0 ? '0' : '1';
+    if (action->direction_to_move == 0) {
+      return bp != NULL && breakpoint_hit(bp, r->state, r->head, 0, changed) ? BREAK : HALTED;
+    }
+    r->head += action->direction_to_move;
+    if (r->head < r->min_pos) {
+      r->min_pos = r->head;
+    }
+    if (r->head > r->max_pos) {
+      r->max_pos = r->head;
+    }
+    r->state = action->next_state;
+    if (bp != NULL && breakpoint_hit(bp, r->state, r->head, action->direction_to_move, changed)) {
+      return BREAK;
+    }
+  }
+  return RUNNING;
+}
+
+static enum status reference_advance(void* const e, const unsigned long long n) {
+  return reference_advance_watched(e, n, NULL);
+}
+
+static void reference_get_info(const void* const e, struct run_info* const info) {
+  const struct reference_engine* const r = (const struct reference_engine *) e;
+  info->step = r->step;
+  info->state = r->state;
+  info->head = r->head;
+  info->min_pos = r->min_pos;
+  info->max_pos = r->max_pos;
+}
+
+static void reference_read_cells(const void* const e, const ssize_t first, const size_t n, char* const out) {
+  const struct reference_engine* const r = (const struct reference_engine *) e;
+  for (size_t i = 0; i < n; ++i) {
+    const ssize_t pos = first + (ssize_t) i;
+    const int side = pos < 0 ? 1 : 0;
+    const size_t j = pos < 0 ? (size_t) (-pos - 1) : (size_t) pos;
+    out[i] = j < r->cells_len[side] ? r->cells[side][j] : ' ';
+  }
+}
+
+static void reference_destroy(void* const e) {
+  struct reference_engine* const r = (struct reference_engine *) e;
+  free(r->cells[0]);
+  free(r->cells[1]);
+  free(r);
+}
+
+/**
+ * Creates a reference engine positioned at an arbitrary configuration.
+ *
+ * Parameters
+ * ----------
+ * states - Turing machine states
+ * snap   - configuration; snap->info.state must point into states
+ *
+ * Returns
+ * -------
+ * reference engine instance, without a tape limit
+ */
+void* reference_restore(const struct state* const states, const struct snapshot* const snap) {
+  struct reference_engine* const r = (struct reference_engine *) reference_create(states, "", 0, (size_t) -1, NULL);
+  for (ssize_t pos = snap->info.min_pos; pos <= snap->info.max_pos; ++pos) {
+    *reference_cell(r, pos) = snap->cells[pos - snap->info.min_pos];
+  }
+  r->state = snap->info.state;
+  r->head = snap->info.head;
+  r->min_pos = snap->info.min_pos;
+  r->max_pos = snap->info.max_pos;
+  r->step = snap->info.step;
+  return r;
+}
+
+// Hashes bytes with 64-bit FNV-1a, continuing from h.
+static uint64_t fnv1a(uint64_t h, const void* const data, const size_t n) {
+  const unsigned char* const bytes = (const unsigned char *) data;
+  for (size_t i = 0; i < n; ++i) {
+    h ^= bytes[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+// Paged engine: the tape is divided into pages of PAGE_LEN cells. Only the
+// PAGED_HOT_PAGES most recently visited pages are kept as plain cells; the
+// others are run-length encoded into a pool in which identical pages are
+// stored once and shared by reference count. A page is decoded again when the
+// head arrives, and pages never visited are not stored at all.
+#define PAGED_HOT_PAGES 64
+static const ssize_t PAGE_LEN = 4096;
+
+// A run-length encoded page in the pool: pairs of a cell and a run length,
+// the length as a little-endian base-128 varint. A page whose encoding would
+// be no shorter than its cells is stored raw instead.
+struct page_blob {
+  uint64_t hash;
+  size_t refs;
+  size_t len;
+  int raw; // non-zero if data holds the PAGE_LEN cells as they are
+  struct page_blob* next; // next blob in the same bucket
+  unsigned char data[];
+};
+
+// Content-addressed store of encoded pages.
+struct page_pool {
+  struct page_blob** buckets;
+  size_t buckets_len; // a power of two
+  size_t blobs_len;
+  struct run_pool* run_pool; // only counts allocations
+};
+
+struct paged_page {
+  char* cells; // PAGE_LEN cells if hot, otherwise NULL
+  struct page_blob* blob; // encoded cells if cold, or NULL if never visited
+  unsigned long long last_used; // step at which the head last left the page
+};
+
+struct paged_engine;
+typedef enum status (*paged_loop)(struct paged_engine* p, unsigned long long n, struct breakpoints* bp);
+struct paged_engine {
+  const paged_loop* loops; // as in struct flat_engine
+  const struct state* state;
+  struct paged_page* pages; // pages first_page, first_page + 1, ...
+  ssize_t first_page;
+  size_t pages_len;
+  ssize_t hot[PAGED_HOT_PAGES]; // page numbers of hot pages
+  size_t hot_len;
+  struct page_pool pool;
+  ssize_t head;
+  ssize_t min_pos;
+  ssize_t max_pos;
+  size_t max_tape_len;
+  unsigned long long step;
+};
+
+static ssize_t page_of(const ssize_t pos) {
+  return pos >= 0 ? pos / PAGE_LEN : -((-pos - 1) / PAGE_LEN) - 1;
+}
+
+// Adds an encoded page to the pool, or takes another reference to an
+// identical one.
+static struct page_blob* page_pool_intern(struct page_pool* const pool, const unsigned char* const data,
+                                          const size_t len, const int raw) {
+  const uint64_t hash = fnv1a(14695981039346656037ull, data, len);
+  for (struct page_blob* b = pool->buckets[hash & (pool->buckets_len - 1)]; b != NULL; b = b->next) {
+    if (b->hash == hash && b->len == len && b->raw == raw && memcmp(b->data, data, len) == 0) {
+      ++b->refs;
+      return b;
+    }
+  }
+  if (pool->blobs_len >= pool->buckets_len) { // Rehash.
+    const size_t buckets_len = 2 * pool->buckets_len;
+    struct page_blob** const buckets = (struct page_blob **) calloc(buckets_len, sizeof(struct page_blob*));
+    if (buckets == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    pool_count_alloc(pool->run_pool);
+    for (size_t i = 0; i < pool->buckets_len; ++i) {
+      for (struct page_blob* b = pool->buckets[i]; b != NULL; ) {
+        struct page_blob* const next = b->next;
+        b->next = buckets[b->hash & (buckets_len - 1)];
+        buckets[b->hash & (buckets_len - 1)] = b;
+        b = next;
+      }
+    }
+    free(pool->buckets);
+    pool->buckets = buckets;
+    pool->buckets_len = buckets_len;
+  }
+  struct page_blob* const b = (struct page_blob *) malloc(sizeof(struct page_blob) + len);
+  if (b == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  pool_count_alloc(pool->run_pool);
+  b->hash = hash;
+  b->refs = 1;
+  b->len = len;
+  b->raw = raw;
+  memcpy(b->data, data, len);
+  b->next = pool->buckets[hash & (pool->buckets_len - 1)];
+  pool->buckets[hash & (pool->buckets_len - 1)] = b;
+  ++pool->blobs_len;
+  return b;
+}
+
+// Drops a reference to an encoded page, freeing it with the last one.
+static void page_pool_release(struct page_pool* const pool, struct page_blob* const blob) {
+  if (--blob->refs > 0) {
+    return;
+  }
+  struct page_blob** b = pool->buckets + (blob->hash & (pool->buckets_len - 1));
+  while (*b != blob) {
+    b = &((*b)->next);
+  }
+  *b = blob->next;
+  --pool->blobs_len;
+  free(blob);
+}
+
+// Encodes PAGE_LEN cells into the pool.
+static struct page_blob* page_encode(struct page_pool* const pool, const char* const cells) {
+  unsigned char data[PAGE_LEN * 2]; // at worst a cell and a one-byte length per cell
+  size_t len = 0;
+  for (ssize_t i = 0; i < PAGE_LEN; ) {
+    if (len >= (size_t) PAGE_LEN) {
+      return page_pool_intern(pool, (const unsigned char *) cells, PAGE_LEN, 1);
+    }
+    ssize_t run = 1;
+    while (i + run < PAGE_LEN && cells[i + run] == cells[i]) {
+      ++run;
+    }
+    data[len++] = (unsigned char) cells[i];
+    for (size_t r = run; ; r >>= 7) {
+      data[len++] = (unsigned char) ((r & 0x7f) | (r >= 0x80 ? 0x80 : 0));
+      if (r < 0x80) {
+        break;
+      }
+    }
+    i += run;
+  }
+  return page_pool_intern(pool, data, len, 0);
+}
+
+static void page_decode(const struct page_blob* const blob, char* const cells) {
+  if (blob->raw) {
+    memcpy(cells, blob->data, PAGE_LEN);
+    return;
+  }
+  ssize_t i = 0;
+  for (size_t j = 0; j < blob->len; ) {
+    const char c = (char) blob->data[j++];
+    size_t run = 0;
+    for (int shift = 0; ; shift += 7) {
+      const unsigned char byte = blob->data[j++];
+      run |= (size_t) (byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        break;
+      }
+    }
+    memset(cells + i, c, run);
+    i += run;
+  }
+}
+
+// Returns the entry for a page, extending the page table if needed.
+static struct paged_page* paged_page(struct paged_engine* const p, const ssize_t page) {
+  if (page < p->first_page || page >= p->first_page + (ssize_t) p->pages_len) {
+    const ssize_t first = page < p->first_page ? page - (ssize_t) p->pages_len : p->first_page;
+    const ssize_t last = page >= p->first_page + (ssize_t) p->pages_len
+                         ? page + (ssize_t) p->pages_len : p->first_page + (ssize_t) p->pages_len - 1;
+    const size_t pages_len = last - first + 1;
+    struct paged_page* const pages = (struct paged_page *) calloc(pages_len, sizeof(struct paged_page));
+    if (pages == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    pool_count_alloc(p->pool.run_pool);
+    if (p->pages_len > 0) {
+      memcpy(pages + (p->first_page - first), p->pages, p->pages_len * sizeof(struct paged_page));
+    }
+    free(p->pages);
+    p->pages = pages;
+    p->first_page = first;
+    p->pages_len = pages_len;
+  }
+  return p->pages + (page - p->first_page);
+}
+
+// Makes a page hot and returns its cells, encoding the least recently used
+// hot page if there are too many.
+static char* paged_load(struct paged_engine* const p, const ssize_t page) {
+  struct paged_page* pg = paged_page(p, page);
+  if (pg->cells != NULL) {
+    return pg->cells;
+  }
+  char* cells = NULL;
+  if (p->hot_len == PAGED_HOT_PAGES) {
+    size_t lru = 0;
+    for (size_t i = 1; i < p->hot_len; ++i) {
+      if (p->pages[p->hot[i] - p->first_page].last_used < p->pages[p->hot[lru] - p->first_page].last_used) {
+        lru = i;
+      }
+    }
+    struct paged_page* const cold = p->pages + (p->hot[lru] - p->first_page);
+    cold->blob = page_encode(&(p->pool), cold->cells);
+    cells = cold->cells;
+    cold->cells = NULL;
+    p->hot[lru] = p->hot[--p->hot_len];
+  } else {
+    cells = (char *) malloc(PAGE_LEN);
+    if (cells == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    pool_count_alloc(p->pool.run_pool);
+  }
+  if (pg->blob != NULL) {
+    page_decode(pg->blob, cells);
+    page_pool_release(&(p->pool), pg->blob);
+    pg->blob = NULL;
+  } else {
+    memset(cells, ' ', PAGE_LEN);
+  }
+  pg->cells = cells;
+  p->hot[p->hot_len++] = page;
+  return cells;
+}
+
+static enum status paged_loop_unlimited(struct paged_engine* p, unsigned long long n, struct breakpoints* bp);
+static enum status paged_loop_unlimited_watched(struct paged_engine* p, unsigned long long n, struct breakpoints* bp);
+static enum status paged_loop_limited(struct paged_engine* p, unsigned long long n, struct breakpoints* bp);
+static enum status paged_loop_limited_watched(struct paged_engine* p, unsigned long long n, struct breakpoints* bp);
+
+// The step loops of the paged engine; see flat_loops.
+static const paged_loop paged_loops[2][2] = {
+  { paged_loop_unlimited, paged_loop_unlimited_watched },
+  { paged_loop_limited, paged_loop_limited_watched },
+};
+
+static void* paged_create(const struct state* const states, const char* const initial_tape,
+                          const size_t initial_tape_len, const size_t max_tape_len, struct run_pool* const pool) {
+  // Pages are shared through the page pool instead of the run pool.
+  struct paged_engine* const p = (struct paged_engine *) calloc(1, sizeof(struct paged_engine));
+  if (p == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  p->pool.run_pool = pool;
+  p->pool.buckets_len = 64;
+  p->pool.buckets = (struct page_blob **) calloc(p->pool.buckets_len, sizeof(struct page_blob*));
+  if (p->pool.buckets == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  pool_count_alloc(pool);
+  pool_count_alloc(pool);
+  p->state = states;
+  for (size_t i = 0; i < initial_tape_len; i += PAGE_LEN) {
+    const size_t n = initial_tape_len - i < (size_t) PAGE_LEN ? initial_tape_len - i : (size_t) PAGE_LEN;
+    char* const cells = paged_load(p, i / PAGE_LEN);
+    memcpy(cells, initial_tape + i, n);
+  }
+  paged_load(p, 0);
+  p->max_pos = initial_tape_len > 0 ? initial_tape_len - 1 : 0;
+  p->loops = paged_loops[max_tape_len != SIZE_MAX];
+  p->max_tape_len = max_tape_len;
+  return p;
+}
+
+// The step loop of the paged engine; see flat_advance_impl(). The span of
+// visited cells only grows when the head passes min_pos or max_pos, so the
+// limit is checked there.
+static inline __attribute__((always_inline))
+enum status paged_advance_impl(struct paged_engine* const p, const unsigned long long n,
+                               struct breakpoints* const bp, const int limited) {
+  const struct state* state = p->state;
+  ssize_t head = p->head;
+  ssize_t min_pos = p->min_pos;
+  ssize_t max_pos = p->max_pos;
+  unsigned long long step = p->step;
+  ssize_t page = page_of(head);
+  char* cells = paged_load(p, page);
+  ssize_t ix = head - page * PAGE_LEN;
+  enum status status = RUNNING;
+  if (limited && (size_t) (max_pos - min_pos + 1) > p->max_tape_len) {
+    return TAPE_LIMIT;
+  }
+  unsigned long long end = n;
+  for (unsigned long long i = 0; i < end; ++i) {
+    ++step;
+    const char curr_value = cells[ix];
+    const struct action* const action = curr_value == '1' ? &(state->action1) : &(state->action0);
+    cells[ix] = action->value_to_write == 0 ? '0' : '1';
+    if (action->direction_to_move == 0) {
+      status = bp != NULL && breakpoint_hit(bp, state, head, 0,
+                                            (curr_value == '1') != (action->value_to_write != 0)) ? BREAK : HALTED;
+      break;
+    }
+    head += action->direction_to_move;
+    ix += action->direction_to_move;
+    if (head < min_pos || head > max_pos) {
+      min_pos = head < min_pos ? head : min_pos;
+      max_pos = head > max_pos ? head : max_pos;
+      if (limited && (size_t) (max_pos - min_pos + 1) > p->max_tape_len) {
+        end = i + 1;
+      }
+    }
+    if (ix < 0 || ix == PAGE_LEN) { // Move to the next page.
+      paged_page(p, page)->last_used = step;
+      page += action->direction_to_move;
+      cells = paged_load(p, page);
+      ix = head - page * PAGE_LEN;
+    }
+    state = action->next_state;
+    if (bp != NULL && breakpoint_hit(bp, state, head, action->direction_to_move,
+                                     (curr_value == '1') != (action->value_to_write != 0))) {
+      status = BREAK;
+      break;
+    }
+  }
+  p->state = state;
+  p->head = head;
+  p->min_pos = min_pos;
+  p->max_pos = max_pos;
+  p->step = step;
+  return status == RUNNING && end < n ? TAPE_LIMIT : status;
+}
+
+static enum status paged_loop_unlimited(struct paged_engine* const p, const unsigned long long n,
+                                        struct breakpoints* const bp) {
+  (void) bp;
+  return paged_advance_impl(p, n, NULL, 0);
+}
+
+static enum status paged_loop_unlimited_watched(struct paged_engine* const p, const unsigned long long n,
+                                                struct breakpoints* const bp) {
+  return paged_advance_impl(p, n, bp, 0);
+}
+
+static enum status paged_loop_limited(struct paged_engine* const p, const unsigned long long n,
+                                      struct breakpoints* const bp) {
+  (void) bp;
+  return paged_advance_impl(p, n, NULL, 1);
+}
+
+static enum status paged_loop_limited_watched(struct paged_engine* const p, const unsigned long long n,
+                                              struct breakpoints* const bp) {
+  return paged_advance_impl(p, n, bp, 1);
+}
+
+static enum status paged_advance(void* const e, const unsigned long long n) {
+  struct paged_engine* const p = (struct paged_engine *) e;
+  return p->loops[0](p, n, NULL);
+}
+
+static enum status paged_advance_watched(void* const e, const unsigned long long n, struct breakpoints* const bp) {
+  struct paged_engine* const p = (struct paged_engine *) e;
+  return p->loops[1](p, n, bp);
+}
+
+static void paged_get_info(const void* const e, struct run_info* const info) {
+  const struct paged_engine* const p = (const struct paged_engine *) e;
+  info->step = p->step;
+  info->state = p->state;
+  info->head = p->head;
+  info->min_pos = p->min_pos;
+  info->max_pos = p->max_pos;
+}
+
+static void paged_read_cells(const void* const e, const ssize_t first, const size_t n, char* const out) {
+  const struct paged_engine* const p = (const struct paged_engine *) e;
+  char* cold = NULL;
+  for (size_t i = 0; i < n; ) {
+    const ssize_t pos = first + (ssize_t) i;
+    const ssize_t page = page_of(pos);
+    const ssize_t ix = pos - page * PAGE_LEN;
+    const size_t len = n - i < (size_t) (PAGE_LEN - ix) ? n - i : (size_t) (PAGE_LEN - ix);
+    const struct paged_page* const pg = page >= p->first_page && page < p->first_page + (ssize_t) p->pages_len
+                                        ? p->pages + (page - p->first_page) : NULL;
+    if (pg != NULL && pg->cells != NULL) {
+      memcpy(out + i, pg->cells + ix, len);
+    } else if (pg != NULL && pg->blob != NULL) {
+      if (cold == NULL) {
+        cold = (char *) malloc(PAGE_LEN);
+        if (cold == NULL) {
+          fputs("Out of memory.\n", stderr);
+          exit(1);
+        }
+        pool_count_alloc(p->pool.run_pool);
+      }
+      page_decode(pg->blob, cold);
+      memcpy(out + i, cold + ix, len);
+    } else {
+      memset(out + i, ' ', len);
+    }
+    i += len;
+  }
+  free(cold);
+}
+
+static void paged_prefetch(const void* const e, const size_t n) {
+  const struct paged_engine* const p = (const struct paged_engine *) e;
+  for (ssize_t pos = p->head - (ssize_t) n; pos <= p->head + (ssize_t) n; pos += 64) {
+    const ssize_t page = page_of(pos);
+    if (page >= p->first_page && page < p->first_page + (ssize_t) p->pages_len
+        && p->pages[page - p->first_page].cells != NULL) {
+      __builtin_prefetch(p->pages[page - p->first_page].cells + (pos - page * PAGE_LEN), 1, 3);
+    }
+  }
+}
+
+static void paged_destroy(void* const e) {
+  struct paged_engine* const p = (struct paged_engine *) e;
+  for (size_t i = 0; i < p->pages_len; ++i) {
+    free(p->pages[i].cells);
+  }
+  for (size_t i = 0; i < p->pool.buckets_len; ++i) {
+    for (struct page_blob* b = p->pool.buckets[i]; b != NULL; ) {
+      struct page_blob* const next = b->next;
+      free(b);
+      b = next;
+    }
+  }
+  free(p->pool.buckets);
+  free(p->pages);
+  free(p);
+}
+
+// Disk engine: the tape is divided into pages of DISK_PAGE_LEN cells stored
+// in a scratch file, so the tape is bounded by disk space rather than memory.
+// Pages are worked on in a pool of DISK_FRAMES frames. An I/O thread reads
+// the pages ahead of the head, in the direction it last moved, while the
+// machine runs, and writes back modified pages once more than
+// DISK_DIRTY_FRAMES of them have accumulated, so that a frame can usually be
+// reused without waiting. Pages never visited are not stored at all.
+#define DISK_FRAMES 256
+static const ssize_t DISK_PAGE_LEN = 1 << 14;
+static const size_t DISK_READ_AHEAD = 4; // pages
+static const size_t DISK_DIRTY_FRAMES = 64;
+
+struct disk_page {
+  size_t frame; // 1 + index of the frame holding the page, or 0
+  off_t slot; // 1 + index of the page in the scratch file, or 0 if not stored
+  int loading; // non-zero while a read-ahead has not been waited for
+};
+
+enum disk_frame_state {
+  DISK_IDLE,
+  DISK_READING,
+  DISK_WRITING,
+};
+
+// While a frame is not idle, its cells belong to the I/O thread, except that
+// they may still be read while they are written.
+struct disk_frame {
+  char* cells; // DISK_PAGE_LEN cells, allocated on first use
+  ssize_t page; // page held, if mapped
+  int mapped;
+  int dirty;
+  enum disk_frame_state state; // guarded by the engine's lock
+  off_t offset; // offset in the scratch file of the pending I/O
+  unsigned long long last_used; // step at which the head last left the page
+};
+
+struct disk_engine;
+typedef enum status (*disk_loop)(struct disk_engine* p, unsigned long long n, struct breakpoints* bp);
+struct disk_engine {
+  const disk_loop* loops; // as in struct flat_engine
+  const struct state* state;
+  struct disk_page* pages; // pages first_page, first_page + 1, ...
+  ssize_t first_page;
+  size_t pages_len;
+  struct disk_frame frames[DISK_FRAMES];
+  size_t current; // frame of the page under the head, or DISK_FRAMES
+  size_t dirty_len; // dirty frames
+  int fd; // scratch file, already unlinked, or -1 until a page is written
+  off_t slots_len;
+  pthread_t io_thread;
+  pthread_mutex_t lock;
+  pthread_cond_t io_queued;
+  pthread_cond_t io_done;
+  size_t queue[DISK_FRAMES]; // frames with pending I/O
+  size_t queue_first;
+  size_t queue_len;
+  int stopping;
+  ssize_t head;
+  ssize_t min_pos;
+  ssize_t max_pos;
+  size_t max_tape_len;
+  unsigned long long step;
+  struct run_pool* pool; // only counts allocations
+};
+
+// Reads or writes n bytes of the scratch file at offset.
+static void disk_io(const int fd, char* const data, const size_t n, const off_t offset, const int write) {
+  for (size_t done = 0; done < n; ) {
+    const ssize_t len = write ? pwrite(fd, data + done, n - done, offset + done)
+                              : pread(fd, data + done, n - done, offset + done);
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+    if (len <= 0) {
+      fprintf(stderr, "Error %s scratch file.\n", write ? "writing" : "reading");
+      exit(1);
+    }
+    done += len;
+  }
+}
+
+// Performs the queued reads and writes until the engine is destroyed.
+static void* disk_io_thread(void* const arg) {
+  struct disk_engine* const p = (struct disk_engine *) arg;
+  pthread_mutex_lock(&(p->lock));
+  for (;;) {
+    while (p->queue_len == 0 && !p->stopping) {
+      pthread_cond_wait(&(p->io_queued), &(p->lock));
+    }
+    if (p->stopping) {
+      break;
+    }
+    struct disk_frame* const f = p->frames + p->queue[p->queue_first];
+    p->queue_first = (p->queue_first + 1) % DISK_FRAMES;
+    --p->queue_len;
+    const int write = f->state == DISK_WRITING;
+    pthread_mutex_unlock(&(p->lock));
+    disk_io(p->fd, f->cells, DISK_PAGE_LEN, f->offset, write);
+    pthread_mutex_lock(&(p->lock));
+    f->state = DISK_IDLE;
+    pthread_cond_broadcast(&(p->io_done));
+  }
+  pthread_mutex_unlock(&(p->lock));
+  return NULL;
+}
+
+// Hands a frame to the I/O thread; the lock must be held.
+static void disk_enqueue(struct disk_engine* const p, const size_t frame, const enum disk_frame_state state,
+                         const off_t offset) {
+  p->frames[frame].state = state;
+  p->frames[frame].offset = offset;
+  p->queue[(p->queue_first + p->queue_len++) % DISK_FRAMES] = frame;
+  pthread_cond_signal(&(p->io_queued));
+}
+
+// Creates the scratch file, in $TMPDIR or /var/tmp, and starts the I/O
+// thread. This is put off until a page is first written, so short runs touch
+// neither the disk nor a thread.
+static void disk_open_scratch(struct disk_engine* const p) {
+  const char* const dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/var/tmp";
+  char* const path = (char *) malloc(strlen(dir) + sizeof("/penrose-turing-XXXXXX"));
+  if (path == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  pool_count_alloc(p->pool);
+  sprintf(path, "%s/penrose-turing-XXXXXX", dir);
+  p->fd = mkstemp(path);
+  if (p->fd < 0) {
+    fprintf(stderr, "Error creating file %s.\n", path);
+    exit(1);
+  }
+  unlink(path);
+  free(path);
+  if (pthread_create(&(p->io_thread), NULL, disk_io_thread, p) != 0) {
+    fputs("Error creating I/O thread.\n", stderr);
+    exit(1);
+  }
+}
+
+// Returns the offset in the scratch file of a page, giving it a slot if it
+// has none.
+static off_t disk_slot(struct disk_engine* const p, const ssize_t page) {
+  struct disk_page* const pg = p->pages + (page - p->first_page);
+  if (pg->slot == 0) {
+    if (p->fd < 0) {
+      disk_open_scratch(p);
+    }
+    pg->slot = ++p->slots_len;
+  }
+  return (pg->slot - 1) * DISK_PAGE_LEN;
+}
+
+// Returns the entry for a page, extending the page table if needed.
+static struct disk_page* disk_page(struct disk_engine* const p, const ssize_t page) {
+  if (page < p->first_page || page >= p->first_page + (ssize_t) p->pages_len) {
+    const ssize_t first = page < p->first_page ? page - (ssize_t) p->pages_len : p->first_page;
+    const ssize_t last = page >= p->first_page + (ssize_t) p->pages_len
+                         ? page + (ssize_t) p->pages_len : p->first_page + (ssize_t) p->pages_len - 1;
+    const size_t pages_len = last - first + 1;
+    struct disk_page* const pages = (struct disk_page *) calloc(pages_len, sizeof(struct disk_page));
+    if (pages == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    pool_count_alloc(p->pool);
+    if (p->pages_len > 0) {
+      memcpy(pages + (p->first_page - first), p->pages, p->pages_len * sizeof(struct disk_page));
+    }
+    free(p->pages);
+    p->pages = pages;
+    p->first_page = first;
+    p->pages_len = pages_len;
+  }
+  return p->pages + (page - p->first_page);
+}
+
+/**
+ * Frees a frame for another page: an unused frame if there is one, otherwise
+ * the least recently used idle frame other than the current one, preferring
+ * clean frames. A dirty frame is written back before it is returned.
+ *
+ * Parameters
+ * ----------
+ * p          - disk engine
+ * clean_only - non-zero to return only a frame that need not be written
+ *              back, and not to wait for one
+ *
+ * Returns
+ * -------
+ * index of the frame, or DISK_FRAMES if clean_only is set and there is no
+ * such frame
+ */
+static size_t disk_evict(struct disk_engine* const p, const int clean_only) {
+  size_t victim = DISK_FRAMES;
+  pthread_mutex_lock(&(p->lock));
+  for (;;) {
+    for (size_t i = 0; i < DISK_FRAMES; ++i) {
+      const struct disk_frame* const f = p->frames + i;
+      if (f->state != DISK_IDLE || i == p->current || (clean_only && f->dirty)) {
+        continue;
+      }
+      if (!f->mapped) {
+        victim = i;
+        break;
+      }
+      if (victim == DISK_FRAMES || f->dirty < p->frames[victim].dirty
+          || (f->dirty == p->frames[victim].dirty && f->last_used < p->frames[victim].last_used)) {
+        victim = i;
+      }
+    }
+    if (victim != DISK_FRAMES || clean_only) {
+      break;
+    }
+    pthread_cond_wait(&(p->io_done), &(p->lock));
+  }
+  pthread_mutex_unlock(&(p->lock));
+  if (victim == DISK_FRAMES) {
+    return victim;
+  }
+  struct disk_frame* const f = p->frames + victim;
+  if (f->mapped) {
+    if (f->dirty) {
+      const off_t offset = disk_slot(p, f->page); // may open the scratch file, so before reading p->fd
+      disk_io(p->fd, f->cells, DISK_PAGE_LEN, offset, 1);
+      --p->dirty_len;
+    }
+    struct disk_page* const pg = p->pages + (f->page - p->first_page);
+    pg->frame = 0;
+    pg->loading = 0;
+  } else if (f->cells == NULL) {
+    f->cells = (char *) malloc(DISK_PAGE_LEN);
+    if (f->cells == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    pool_count_alloc(p->pool);
+  }
+  f->mapped = 0;
+  f->dirty = 0;
+  return victim;
+}
+
+// Waits until the I/O thread is done with a frame.
+static void disk_wait(struct disk_engine* const p, const size_t frame) {
+  pthread_mutex_lock(&(p->lock));
+  while (p->frames[frame].state != DISK_IDLE) {
+    pthread_cond_wait(&(p->io_done), &(p->lock));
+  }
+  pthread_mutex_unlock(&(p->lock));
+}
+
+// Starts reading the stored pages that follow a page in direction dir into
+// clean frames.
+static void disk_read_ahead(struct disk_engine* const p, const ssize_t page, const int dir) {
+  for (size_t i = 1; i <= DISK_READ_AHEAD && p->slots_len > 0; ++i) {
+    const ssize_t next = page + dir * (ssize_t) i;
+    if (next < p->first_page || next >= p->first_page + (ssize_t) p->pages_len) {
+      break;
+    }
+    struct disk_page* const pg = p->pages + (next - p->first_page);
+    if (pg->frame != 0 || pg->slot == 0) {
+      continue;
+    }
+    const size_t frame = disk_evict(p, 1);
+    if (frame == DISK_FRAMES) {
+      break;
+    }
+    struct disk_frame* const f = p->frames + frame;
+    f->page = next;
+    f->mapped = 1;
+    f->last_used = p->step;
+    pg->frame = frame + 1;
+    pg->loading = 1;
+    pthread_mutex_lock(&(p->lock));
+    disk_enqueue(p, frame, DISK_READING, (pg->slot - 1) * DISK_PAGE_LEN);
+    pthread_mutex_unlock(&(p->lock));
+  }
+}
+
+// Starts writing back the least recently used modified pages while more than
+// DISK_DIRTY_FRAMES frames are dirty.
+static void disk_write_behind(struct disk_engine* const p) {
+  if (p->dirty_len <= DISK_DIRTY_FRAMES) {
+    return;
+  }
+  pthread_mutex_lock(&(p->lock));
+  for (;;) {
+    size_t dirty = 0;
+    size_t lru = DISK_FRAMES;
+    for (size_t i = 0; i < DISK_FRAMES; ++i) {
+      const struct disk_frame* const f = p->frames + i;
+      if (f->state == DISK_IDLE && f->dirty && i != p->current) {
+        ++dirty;
+        if (lru == DISK_FRAMES || f->last_used < p->frames[lru].last_used) {
+          lru = i;
+        }
+      }
+    }
+    if (dirty <= DISK_DIRTY_FRAMES) {
+      break;
+    }
+    p->frames[lru].dirty = 0;
+    --p->dirty_len;
+    disk_enqueue(p, lru, DISK_WRITING, disk_slot(p, p->frames[lru].page));
+  }
+  pthread_mutex_unlock(&(p->lock));
+}
+
+/**
+ * Moves the head onto a page and returns its cells, reading the page from
+ * the scratch file if it is not in a frame, then starts reading ahead and
+ * writing back.
+ *
+ * Parameters
+ * ----------
+ * p    - disk engine
+ * page - page
+ * dir  - direction in which the head is moving, -1 or 1
+ * step - current step
+ *
+ * Returns
+ * -------
+ * the cells of the page
+ */
+static char* disk_load(struct disk_engine* const p, const ssize_t page, const int dir,
+                       const unsigned long long step) {
+  if (p->current != DISK_FRAMES) {
+    p->frames[p->current].last_used = step;
+  }
+  p->step = step;
+  struct disk_page* pg = disk_page(p, page);
+  size_t frame;
+  if (pg->frame != 0) {
+    frame = pg->frame - 1;
+    if (p->fd >= 0) {
+      disk_wait(p, frame); // a read-ahead or a write-behind may be pending
+    }
+    pg->loading = 0;
+  } else {
+    frame = disk_evict(p, 0);
+    struct disk_frame* const f = p->frames + frame;
+    if (pg->slot != 0) {
+      disk_io(p->fd, f->cells, DISK_PAGE_LEN, (pg->slot - 1) * DISK_PAGE_LEN, 0);
+    } else {
+      memset(f->cells, ' ', DISK_PAGE_LEN);
+    }
+    f->page = page;
+    f->mapped = 1;
+    pg->frame = frame + 1;
+  }
+  p->current = frame;
+  if (!p->frames[frame].dirty) {
+    p->frames[frame].dirty = 1; // every step writes the cell under the head
+    ++p->dirty_len;
+  }
+  p->frames[frame].last_used = step;
+  disk_read_ahead(p, page, dir);
+  disk_write_behind(p);
+  return p->frames[frame].cells;
+}
+
+static enum status disk_loop_unlimited(struct disk_engine* p, unsigned long long n, struct breakpoints* bp);
+static enum status disk_loop_unlimited_watched(struct disk_engine* p, unsigned long long n, struct breakpoints* bp);
+static enum status disk_loop_limited(struct disk_engine* p, unsigned long long n, struct breakpoints* bp);
+static enum status disk_loop_limited_watched(struct disk_engine* p, unsigned long long n, struct breakpoints* bp);
+
+// The step loops of the disk engine; see flat_loops.
+static const disk_loop disk_loops[2][2] = {
+  { disk_loop_unlimited, disk_loop_unlimited_watched },
+  { disk_loop_limited, disk_loop_limited_watched },
+};
+
+static void* disk_create(const struct state* const states, const char* const initial_tape,
+                         const size_t initial_tape_len, const size_t max_tape_len, struct run_pool* const pool) {
+  // Frames are kept for the life of the engine instead of in the run pool.
+  struct disk_engine* const p = (struct disk_engine *) calloc(1, sizeof(struct disk_engine));
+  if (p == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  pool_count_alloc(pool);
+  p->pool = pool;
+  p->fd = -1;
+  pthread_mutex_init(&(p->lock), NULL);
+  pthread_cond_init(&(p->io_queued), NULL);
+  pthread_cond_init(&(p->io_done), NULL);
+  p->current = DISK_FRAMES;
+  p->state = states;
+  for (size_t i = 0; i < initial_tape_len; i += DISK_PAGE_LEN) {
+    const size_t n = initial_tape_len - i < (size_t) DISK_PAGE_LEN ? initial_tape_len - i : (size_t) DISK_PAGE_LEN;
+    char* const cells = disk_load(p, i / DISK_PAGE_LEN, 1, 0);
+    memcpy(cells, initial_tape + i, n);
+  }
+  disk_load(p, 0, 1, 0);
+  p->max_pos = initial_tape_len > 0 ? initial_tape_len - 1 : 0;
+  p->loops = disk_loops[max_tape_len != SIZE_MAX];
+  p->max_tape_len = max_tape_len;
+  return p;
+}
+
+static ssize_t disk_page_of(const ssize_t pos) {
+  return pos >= 0 ? pos / DISK_PAGE_LEN : -((-pos - 1) / DISK_PAGE_LEN) - 1;
+}
+
+// The step loop of the disk engine; see paged_advance_impl().
+static inline __attribute__((always_inline))
+enum status disk_advance_impl(struct disk_engine* const p, const unsigned long long n,
+                              struct breakpoints* const bp, const int limited) {
+  const struct state* state = p->state;
+  ssize_t head = p->head;
+  ssize_t min_pos = p->min_pos;
+  ssize_t max_pos = p->max_pos;
+  unsigned long long step = p->step;
+  ssize_t page = disk_page_of(head);
+  char* cells = p->frames[p->current].cells;
+  ssize_t ix = head - page * DISK_PAGE_LEN;
+  enum status status = RUNNING;
+  if (limited && (size_t) (max_pos - min_pos + 1) > p->max_tape_len) {
+    return TAPE_LIMIT;
+  }
+  unsigned long long end = n;
+  for (unsigned long long i = 0; i < end; ++i) {
+    ++step;
+    const char curr_value = cells[ix];
+    const struct action* const action = curr_value == '1' ? &(state->action1) : &(state->action0);
+    cells[ix] = action->value_to_write == 0 ? '0' : '1';
+    if (action->direction_to_move == 0) {
+      status = bp != NULL && breakpoint_hit(bp, state, head, 0,
+                                            (curr_value == '1') != (action->value_to_write != 0)) ? BREAK : HALTED;
+      break;
+    }
+    head += action->direction_to_move;
+    ix += action->direction_to_move;
+    if (head < min_pos || head > max_pos) {
+      min_pos = head < min_pos ? head : min_pos;
+      max_pos = head > max_pos ? head : max_pos;
+      if (limited && (size_t) (max_pos - min_pos + 1) > p->max_tape_len) {
+        end = i + 1;
+      }
+    }
+    if (ix < 0 || ix == DISK_PAGE_LEN) { // Move to the next page.
+      page += action->direction_to_move;
+      cells = disk_load(p, page, action->direction_to_move, step);
+      ix = head - page * DISK_PAGE_LEN;
+    }
+    state = action->next_state;
+    if (bp != NULL && breakpoint_hit(bp, state, head, action->direction_to_move,
+                                     (curr_value == '1') != (action->value_to_write != 0))) {
+      status = BREAK;
+      break;
+    }
+  }
+  p->state = state;
+  p->head = head;
+  p->min_pos = min_pos;
+  p->max_pos = max_pos;
+  p->step = step;
+  return status == RUNNING && end < n ? TAPE_LIMIT : status;
+}
+
+static enum status disk_loop_unlimited(struct disk_engine* const p, const unsigned long long n,
+                                       struct breakpoints* const bp) {
+  (void) bp;
+  return disk_advance_impl(p, n, NULL, 0);
+}
+
+static enum status disk_loop_unlimited_watched(struct disk_engine* const p, const unsigned long long n,
+                                               struct breakpoints* const bp) {
+  return disk_advance_impl(p, n, bp, 0);
+}
+
+static enum status disk_loop_limited(struct disk_engine* const p, const unsigned long long n,
+                                     struct breakpoints* const bp) {
+  (void) bp;
+  return disk_advance_impl(p, n, NULL, 1);
+}
+
+static enum status disk_loop_limited_watched(struct disk_engine* const p, const unsigned long long n,
+                                             struct breakpoints* const bp) {
+  return disk_advance_impl(p, n, bp, 1);
+}
+
+static enum status disk_advance(void* const e, const unsigned long long n) {
+  struct disk_engine* const p = (struct disk_engine *) e;
+  return p->loops[0](p, n, NULL);
+}
+
+static enum status disk_advance_watched(void* const e, const unsigned long long n, struct breakpoints* const bp) {
+  struct disk_engine* const p = (struct disk_engine *) e;
+  return p->loops[1](p, n, bp);
+}
+
+static void disk_get_info(const void* const e, struct run_info* const info) {
+  const struct disk_engine* const p = (const struct disk_engine *) e;
+  info->step = p->step;
+  info->state = p->state;
+  info->head = p->head;
+  info->min_pos = p->min_pos;
+  info->max_pos = p->max_pos;
+}
+
+// Pages in frames are copied unless a read-ahead into the frame may still be
+// in progress; the others are read from the scratch file, where every page
+// that is not dirty is up to date.
+static void disk_read_cells(const void* const e, const ssize_t first, const size_t n, char* const out) {
+  const struct disk_engine* const p = (const struct disk_engine *) e;
+  for (size_t i = 0; i < n; ) {
+    const ssize_t pos = first + (ssize_t) i;
+    const ssize_t page = disk_page_of(pos);
+    const ssize_t ix = pos - page * DISK_PAGE_LEN;
+    const size_t len = n - i < (size_t) (DISK_PAGE_LEN - ix) ? n - i : (size_t) (DISK_PAGE_LEN - ix);
+    const struct disk_page* const pg = page >= p->first_page && page < p->first_page + (ssize_t) p->pages_len
+                                       ? p->pages + (page - p->first_page) : NULL;
+    if (pg != NULL && pg->frame != 0 && !pg->loading) {
+      memcpy(out + i, p->frames[pg->frame - 1].cells + ix, len);
+    } else if (pg != NULL && pg->slot != 0) {
+      disk_io(p->fd, out + i, len, (pg->slot - 1) * DISK_PAGE_LEN + ix, 0);
+    } else {
+      memset(out + i, ' ', len);
+    }
+    i += len;
+  }
+}
+
+static void disk_destroy(void* const e) {
+  struct disk_engine* const p = (struct disk_engine *) e;
+  if (p->fd >= 0) {
+    pthread_mutex_lock(&(p->lock));
+    p->stopping = 1;
+    pthread_cond_signal(&(p->io_queued));
+    pthread_mutex_unlock(&(p->lock));
+    pthread_join(p->io_thread, NULL);
+    close(p->fd);
+  }
+  pthread_mutex_destroy(&(p->lock));
+  pthread_cond_destroy(&(p->io_queued));
+  pthread_cond_destroy(&(p->io_done));
+  for (size_t i = 0; i < DISK_FRAMES; ++i) {
+    free(p->frames[i].cells);
+  }
+  free(p->pages);
+  free(p);
+}
+
+// The available engines.
+static const struct engine engines[] = {
+  { "flat", flat_create, flat_advance, flat_advance_watched, flat_get_info, flat_read_cells, flat_destroy,
+    flat_prefetch, 1 },
+  { "reference", reference_create, reference_advance, reference_advance_watched, reference_get_info,
+    reference_read_cells, reference_destroy, NULL, 1 },
+  { "paged", paged_create, paged_advance, paged_advance_watched, paged_get_info, paged_read_cells, paged_destroy,
+    paged_prefetch, 1 },
+  { "disk", disk_create, disk_advance, disk_advance_watched, disk_get_info, disk_read_cells, disk_destroy, NULL,
+    0 },
+};
+
+/**
+ * Looks up an engine by name.
+ *
+ * Parameters
+ * ----------
+ * name - engine name
+ *
+ * Returns
+ * -------
+ * the engine, or NULL if there is no engine with that name
+ */
+const struct engine* find_engine(const char* const name) {
+  for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); ++i) {
+    if (strcmp(engines[i].name, name) == 0) {
+      return engines + i;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Captures the configuration of an engine.
+ *
+ * Parameters
+ * ----------
+ * engine - engine
+ * e      - engine instance
+ *
+ * "Out" Parameters
+ * ----------------
+ * snap - snapshot; its buffer is reused across calls
+ */
+void take_snapshot(const struct engine* const engine, const void* const e, struct snapshot* const snap) {
+  engine->get_info(e, &(snap->info));
+  const size_t cells_len = snap->info.max_pos - snap->info.min_pos + 1;
+  if (cells_len > snap->cells_cap) {
+    free(snap->cells);
+    snap->cells = (char *) malloc(cells_len);
+    if (snap->cells == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    snap->cells_cap = cells_len;
+  }
+  engine->read_cells(e, snap->info.min_pos, cells_len, snap->cells);
+}
+
+/**
+ * Compares two snapshots.
+ *
+ * Returns
+ * -------
+ * non-zero if the configurations are identical
+ */
+int snapshots_equal(const struct snapshot* const a, const struct snapshot* const b) {
+  return a->info.step == b->info.step
+      && a->info.state->number == b->info.state->number
+      && a->info.head == b->info.head
+      && a->info.min_pos == b->info.min_pos
+      && a->info.max_pos == b->info.max_pos
+      && memcmp(a->cells, b->cells, a->info.max_pos - a->info.min_pos + 1) == 0;
+}
+
+/**
+ * Prints a snapshot in a format similar to print_tape().
+ *
+ * Parameters
+ * ----------
+ * fp    - output stream
+ * label - label to print before the configuration
+ * snap  - snapshot
+ */
+void print_snapshot(FILE* const fp, const char* const label, const struct snapshot* const snap) {
+  fprintf(fp, "%-10s %5llu %5zX: [%zd]", label, snap->info.step, snap->info.state->number, snap->info.min_pos);
+  const size_t cells_len = snap->info.max_pos - snap->info.min_pos + 1;
+  const size_t head_ix = snap->info.head - snap->info.min_pos;
+  for (size_t i = 0; i < cells_len; ++i) {
+    if (i == head_ix) {
+      fprintf(fp, "|%c|", snap->cells[i]);
+    } else {
+      fputc(snap->cells[i], fp);
+    }
+  }
+  fputc('\n', fp);
+}
+
+static void* cross_check_thread(void* const arg) {
+  struct cross_check* const cc = (struct cross_check *) arg;
+  while (1) {
+    pthread_barrier_wait(&(cc->start));
+    if (cc->quit) {
+      break;
+    }
+    cc->status = cc->engine->advance(cc->e, cc->n);
+    take_snapshot(cc->engine, cc->e, &(cc->snap));
+    pthread_barrier_wait(&(cc->done));
+  }
+  return NULL;
+}
+
+/**
+ * Starts the reference engine thread for a cross-check.
+ *
+ * Parameters
+ * ----------
+ * states           - Turing machine states
+ * initial_tape     - initial tape
+ * initial_tape_len - initial tape length
+ * max_tape_len     - maximum tape length, which both engines must agree on
+ *
+ * "Out" Parameters
+ * ----------------
+ * cc - cross-check state
+ */
+void cross_check_start(struct cross_check* const cc, const struct state* const states,
+                       const char* const initial_tape, const size_t initial_tape_len, const size_t max_tape_len) {
+  memset(cc, 0, sizeof(struct cross_check));
+  cc->engine = find_engine("reference");
+  cc->e = cc->engine->create(states, initial_tape, initial_tape_len, max_tape_len, NULL);
+  pthread_barrier_init(&(cc->start), NULL, 2);
+  pthread_barrier_init(&(cc->done), NULL, 2);
+  if (pthread_create(&(cc->thread), NULL, cross_check_thread, cc) != 0) {
+    fputs("Error creating cross-check thread.\n", stderr);
+    exit(1);
+  }
+}
+
+/**
+ * Lets the reference engine advance by n steps concurrently with the engine
+ * being checked.
+ */
+void cross_check_begin(struct cross_check* const cc, const unsigned long long n) {
+  cc->n = n;
+  pthread_barrier_wait(&(cc->start));
+}
+
+/**
+ * Waits for the reference engine to complete the current interval and
+ * compares its configuration and status with those of the engine being
+ * checked. On divergence, the first divergent step is reported and the
+ * program exits.
+ */
+void cross_check_end(struct cross_check* const cc, const struct state* const states,
+                     const char* const initial_tape, const size_t initial_tape_len, const size_t max_tape_len,
+                     const struct engine* const engine, const void* const e, const enum status status) {
+  take_snapshot(engine, e, &(cc->other_snap));
+  pthread_barrier_wait(&(cc->done));
+  if (cc->status != status || !snapshots_equal(&(cc->snap), &(cc->other_snap))) {
+    report_divergence(states, initial_tape, initial_tape_len, max_tape_len, engine, cc->last_good_step);
+  }
+  cc->last_good_step = cc->snap.info.step;
+}
+
+/**
+ * Stops the reference engine thread and releases the cross-check state.
+ */
+void cross_check_stop(struct cross_check* const cc) {
+  cc->quit = 1;
+  pthread_barrier_wait(&(cc->start));
+  pthread_join(cc->thread, NULL);
+  pthread_barrier_destroy(&(cc->start));
+  pthread_barrier_destroy(&(cc->done));
+  cc->engine->destroy(cc->e);
+  free(cc->snap.cells);
+  free(cc->other_snap.cells);
+}
+
+/**
+ * Finds and reports the first step at which an engine diverges from the
+ * reference engine, then exits. Both engines are replayed from the start up
+ * to the last step at which they were known to agree, and then compared
+ * after every step.
+ *
+ * Parameters
+ * ----------
+ * states           - Turing machine states
+ * initial_tape     - initial tape
+ * initial_tape_len - initial tape length
+ * max_tape_len     - maximum tape length
+ * engine           - engine which diverged
+ * last_good_step   - step at which the engines last agreed
+ */
+void report_divergence(const struct state* const states, const char* const initial_tape,
+                       const size_t initial_tape_len, const size_t max_tape_len, const struct engine* const engine,
+                       const unsigned long long last_good_step) {
+  const struct engine* const reference = find_engine("reference");
+  void* const a = reference->create(states, initial_tape, initial_tape_len, max_tape_len, NULL);
+  void* const b = engine->create(states, initial_tape, initial_tape_len, max_tape_len, NULL);
+  struct snapshot snap_a = {0};
+  struct snapshot snap_b = {0};
+  enum status status_a = reference->advance(a, last_good_step);
+  enum status status_b = engine->advance(b, last_good_step);
+  while (1) {
+    take_snapshot(reference, a, &snap_a);
+    take_snapshot(engine, b, &snap_b);
+    if (!snapshots_equal(&snap_a, &snap_b)) {
+      fprintf(stderr, "Engine %s diverges from the reference engine at step %llu.\n",
+              engine->name, snap_a.info.step);
+      print_snapshot(stderr, reference->name, &snap_a);
+      print_snapshot(stderr, engine->name, &snap_b);
+      exit(1);
+    }
+    if ((status_a == TAPE_LIMIT) != (status_b == TAPE_LIMIT)) {
+      fprintf(stderr, "Engine %s diverges from the reference engine at step %llu: only %s stops at the tape "
+                      "limit.\n", engine->name, snap_a.info.step, status_a == TAPE_LIMIT ? reference->name : engine->name);
+      exit(1);
+    }
+    if (status_a != RUNNING || status_b != RUNNING) {
+      break;
+    }
+    status_a = reference->advance(a, 1);
+    status_b = engine->advance(b, 1);
+  }
+  fprintf(stderr, "Engine %s diverged from the reference engine after step %llu, "
+                  "but the divergence could not be reproduced.\n", engine->name, last_good_step);
+  exit(1);
+}
+
+/**
+ * Prints the contents of the tape to stdout.
+ *
+ * Parameters
+ * ----------
+ * tape     - tape string of ' 's, '0's, and '1's
+ * tape_len - tape string length
+ * tape_ix  - index in tape string of current cell
+ * step     - step number of Turing machine operation
+ * state    - pointer to current state of Turing machine
+ */
+void print_tape(const char* const tape, const int tape_len, int tape_ix,
+                unsigned long long step, const struct state* const state) {
+  if (step >= 0) {
+    printf("%5llu ", step);
+  } else {
+    printf("      ");
+  }
+  if (state != NULL) {
+    printf("%5zX:", state->number);
+  } else {
+    printf("   :");
+  }
+  for (int i = 0; i < tape_ix; ++i) {
+    putchar(' ');
+    putchar(tape[i]);
+  }
+  putchar(step > 0 ? '|' : ' ');
+  putchar(tape[tape_ix]);
+  putchar(step > 0 ? '|' : ' ');
+  for (int i = tape_ix + 1; i < tape_len; ++i) {
+    putchar(tape[i]);
+    putchar(' ');
+  }
+  putchar('\n');
+}
+
+/**
+ * Allocates a block from a worker's pool: the smallest free block that is
+ * large enough, or a new one if there is none. Without a pool, this is
+ * malloc().
+ *
+ * Parameters
+ * ----------
+ * pool - pool, or NULL
+ * len  - number of bytes
+ */
+void* pool_alloc(struct run_pool* const pool, const size_t len) {
+  if (pool == NULL) {
+    void* const p = malloc(len > 0 ? len : 1);
+    if (p == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    return p;
+  }
+  size_t best = pool->blocks_len;
+  for (size_t i = 0; i < pool->blocks_len; ++i) {
+    const size_t cap = *(const size_t *) pool->blocks[i];
+    if (cap >= len && (best == pool->blocks_len || cap < *(const size_t *) pool->blocks[best])) {
+      best = i;
+    }
+  }
+  if (best < pool->blocks_len) {
+    char* const block = pool->blocks[best];
+    pool->blocks[best] = pool->blocks[--(pool->blocks_len)];
+    ++(pool->reuses);
+    return block + POOL_HEADER_LEN;
+  }
+  char* const block = (char *) malloc(POOL_HEADER_LEN + len);
+  if (block == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  *(size_t *) block = len;
+  ++(pool->allocs);
+  return block + POOL_HEADER_LEN;
+}
+
+/**
+ * Returns a block from pool_alloc() to the pool. When the pool is full, the
+ * smallest block is freed.
+ *
+ * Parameters
+ * ----------
+ * pool - pool the block came from, or NULL
+ * p    - block, or NULL
+ */
+void pool_free(struct run_pool* const pool, void* const p) {
+  if (pool == NULL || p == NULL) {
+    free(p);
+    return;
+  }
+  char* block = (char *) p - POOL_HEADER_LEN;
+  if (pool->blocks_len < RUN_POOL_BLOCKS) {
+    pool->blocks[pool->blocks_len++] = block;
+    return;
+  }
+  size_t smallest = 0;
+  for (size_t i = 1; i < pool->blocks_len; ++i) {
+    if (*(const size_t *) pool->blocks[i] < *(const size_t *) pool->blocks[smallest]) {
+      smallest = i;
+    }
+  }
+  if (*(const size_t *) pool->blocks[smallest] < *(const size_t *) block) {
+    char* const tmp = pool->blocks[smallest];
+    pool->blocks[smallest] = block;
+    block = tmp;
+  }
+  free(block);
+}
+
+/**
+ * Counts an allocator call made by an engine that keeps its memory outside
+ * the pool, so that --stats reports every allocation of a worker's runs.
+ *
+ * Parameters
+ * ----------
+ * pool - pool of the engine's worker, or NULL
+ */
+void pool_count_alloc(struct run_pool* const pool) {
+  if (pool != NULL) {
+    ++(pool->allocs);
+  }
+}
+
+/**
+ * Frees the blocks held by a pool.
+ */
+void destroy_pool(struct run_pool* const pool) {
+  for (size_t i = 0; i < pool->blocks_len; ++i) {
+    free(pool->blocks[i]);
+  }
+  pool->blocks_len = 0;
+}
+
+/**
+ * Prints the allocation counts of the workers' pools to stderr for --stats.
+ */
+void print_pool_stats(const unsigned long long allocs, const unsigned long long reuses) {
+  fprintf(stderr, "Allocations: %llu from the allocator, %llu reused from worker pools.\n", allocs, reuses);
+}
+
+/**
+ * Returns the default number of worker threads, the number of online CPUs.
+ */
+size_t default_threads(void) {
+  const long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (size_t) n : 1;
+}
+
+// Parses a Linux CPU or node list such as "0-3,8-11" into a set; returns
+// zero if it is malformed.
+static int parse_cpu_list(const char* s, cpu_set_t* const set) {
+  CPU_ZERO(set);
+  while (*s != '\0' && *s != '\n') {
+    char* end;
+    const unsigned long first = strtoul(s, &end, 10);
+    unsigned long last = first;
+    if (end == s) {
+      return 0;
+    }
+    if (*end == '-') {
+      s = end + 1;
+      last = strtoul(s, &end, 10);
+      if (end == s) {
+        return 0;
+      }
+    }
+    for (unsigned long i = first; i <= last && i < CPU_SETSIZE; ++i) {
+      CPU_SET(i, set);
+    }
+    s = *end == ',' ? end + 1 : end;
+  }
+  return 1;
+}
+
+/**
+ * Reads the NUMA nodes from sysfs, keeping those with CPUs this process is
+ * allowed to run on. Without NUMA support there is one node with every
+ * allowed CPU.
+ *
+ * "Out" Parameters
+ * ----------------
+ * topo - NUMA nodes
+ */
+void read_numa_topology(struct numa_topology* const topo) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    CPU_ZERO(&allowed);
+  }
+  topo->nodes_len = 0;
+  char line[4096];
+  cpu_set_t nodes;
+  FILE* fp = fopen("/sys/devices/system/node/online", "r");
+  const int have_nodes = fp != NULL && fgets(line, sizeof(line), fp) != NULL && parse_cpu_list(line, &nodes);
+  if (fp != NULL) {
+    fclose(fp);
+  }
+  for (int node = 0; have_nodes && node < CPU_SETSIZE && topo->nodes_len < MAX_NUMA_NODES; ++node) {
+    if (!CPU_ISSET(node, &nodes)) {
+      continue;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    cpu_set_t* const cpus = topo->cpus + topo->nodes_len;
+    fp = fopen(path, "r");
+    if (fp == NULL || fgets(line, sizeof(line), fp) == NULL || !parse_cpu_list(line, cpus)) {
+      CPU_ZERO(cpus);
+    }
+    if (fp != NULL) {
+      fclose(fp);
+    }
+    CPU_AND(cpus, cpus, &allowed);
+    if (CPU_COUNT(cpus) > 0) {
+      ++(topo->nodes_len);
+    }
+  }
+  if (topo->nodes_len == 0) {
+    topo->nodes_len = 1;
+    topo->cpus[0] = allowed;
+  }
+}
+
+/**
+ * Runs a function on a number of worker threads and waits for all of them to
+ * finish. Each thread receives its own struct worker whose arg is shared; the
+ * workers are expected to claim work from it. On machines with several NUMA
+ * nodes the workers are spread over the nodes in turn and pinned to the CPUs
+ * of their node, so that the memory they allocate is local to it.
+ *
+ * Parameters
+ * ----------
+ * n   - number of threads
+ * fn  - thread function; receives a pointer to a struct worker
+ * arg - argument shared by the workers
+ */
+void run_workers(const size_t n, void* (*fn)(void*), void* const arg) {
+  struct worker* const workers = (struct worker *) calloc(n, sizeof(struct worker));
+  if (workers == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  struct numa_topology topo;
+  read_numa_topology(&topo);
+  for (size_t i = 0; i < n; ++i) {
+    workers[i].ix = i;
+    workers[i].node = i % topo.nodes_len;
+    workers[i].arg = arg;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (topo.nodes_len > 1) {
+      pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), topo.cpus + workers[i].node);
+    }
+    if (pthread_create(&(workers[i].thread), &attr, fn, workers + i) != 0) {
+      fputs("Error creating worker thread.\n", stderr);
+      exit(1);
+    }
+    pthread_attr_destroy(&attr);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  free(workers);
+}
+
+/**
+ * Maps a file into memory read-only.
+ *
+ * Parameters
+ * ----------
+ * f - file name
+ *
+ * "Out" Parameters
+ * ----------------
+ * len - length of the file
+ *
+ * Returns
+ * -------
+ * the mapping, or NULL if the file is empty
+ */
+const char* map_file(const char* const f, size_t* const len) {
+  const int fd = open(f, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Error opening file %s.\n", f);
+    exit(1);
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    fprintf(stderr, "Error reading file %s.\n", f);
+    exit(1);
+  }
+  *len = (size_t) st.st_size;
+  if (*len == 0) {
+    close(fd);
+    return NULL;
+  }
+  void* const p = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "Error mapping file %s.\n", f);
+    exit(1);
+  }
+  close(fd);
+  madvise(p, *len, MADV_SEQUENTIAL);
+  return (const char *) p;
+}
+
+/**
+ * Appends bytes to a buffer, growing it as necessary.
+ */
+void buffer_append(struct buffer* const b, const void* const data, const size_t n) {
+  if (b->len + n > b->cap) {
+    size_t cap = b->cap > 0 ? 2 * b->cap : 4096;
+    while (cap < b->len + n) {
+      cap *= 2;
+    }
+    char* const tmp = (char *) realloc(b->data, cap);
+    if (tmp == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    b->data = tmp;
+    b->cap = cap;
+  }
+  memcpy(b->data + b->len, data, n);
+  b->len += n;
+}
+
+/**
+ * Looks up a machine format by name.
+ *
+ * Returns
+ * -------
+ * 0 on success, -1 if there is no format with that name
+ */
+int find_tm_format(const char* const name, enum tm_format* const format) {
+  for (size_t i = 0; i < sizeof(tm_format_names) / sizeof(tm_format_names[0]); ++i) {
+    if (strcmp(tm_format_names[i], name) == 0) {
+      *format = (enum tm_format) i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Decodes a machine in the standard transition-table text format, e.g.
+ * "1RB1LB_1LA---". States are letters starting from 'A', and groups of two
+ * transitions (after reading '0' and '1') are separated by '_'. A transition
+ * to a letter beyond the last state halts after writing; "---" writes 0 and
+ * halts. Since Penrose's STOP does not move, the direction of halting
+ * transitions is discarded.
+ *
+ * Parameters
+ * ----------
+ * rec     - machine text
+ * len     - length of the text
+ * err_len - size of the error message buffer
+ *
+ * "Out" Parameters
+ * ----------------
+ * states     - pointer to the array of states (memory allocated by this function)
+ * states_len - length of array of states
+ * err        - error message, if the machine is invalid
+ *
+ * Returns
+ * -------
+ * 0 on success, -1 if the machine is invalid
+ */
+int decode_standard(const char* const rec, const size_t len, struct state** const states,
+                    size_t* const states_len, char* const err, const size_t err_len) {
+  if ((len + 1) % 7 != 0) {
+    snprintf(err, err_len, "Invalid machine; expected groups of six characters separated by '_'.");
+    return -1;
+  }
+  const size_t n = (len + 1) / 7;
+  *states = (struct state *) calloc(n, sizeof(struct state));
+  if (*states == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  *states_len = n;
+  for (size_t i = 0; i < n; ++i) {
+    struct state* const state = *states + i;
+    state->number = i;
+    if (i > 0 && rec[7 * i - 1] != '_') {
+      snprintf(err, err_len, "Invalid machine at index %zu; expected '_'.", 7 * i - 1);
+      free(*states);
+      return -1;
+    }
+    for (int c = 0; c < 2; ++c) {
+      const char* const t = rec + 7 * i + 3 * c;
+      struct action* const action = c == 0 ? &(state->action0) : &(state->action1);
+      action->next_state = *states;
+      if (t[0] == '-' && t[1] == '-' && t[2] == '-') {
+        action->value_to_write = 0;
+        action->direction_to_move = 0;
+        continue;
+      }
+      if ((t[0] != '0' && t[0] != '1') || (t[1] != 'R' && t[1] != 'L') || t[2] < 'A' || t[2] > 'Z') {
+        snprintf(err, err_len, "Invalid machine at index %zu; "
+                               "expected a transition such as \"1RB\" or \"---\".", (size_t) (t - rec));
+        free(*states);
+        return -1;
+      }
+      action->value_to_write = t[0] - '0';
+      const size_t next_state_ix = t[2] - 'A';
+      if (next_state_ix >= n) { // halt
+        action->direction_to_move = 0;
+        continue;
+      }
+      action->direction_to_move = t[1] == 'R' ? +1 : -1;
+      if (link_action(*states, n, state, action, next_state_ix, err, err_len) != 0) {
+        free(*states);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * Decodes a machine in the fixed-width binary seed-database format. Each
+ * transition is three bytes: the value to write, the direction (0 for right,
+ * 1 for left) and the next state numbered from 1, where 0 marks an undefined
+ * transition. Undefined transitions write and halt.
+ *
+ * Parameters
+ * ----------
+ * rec        - machine record of 6 * db_states bytes
+ * db_states  - number of states per record
+ * err_len    - size of the error message buffer
+ *
+ * "Out" Parameters
+ * ----------------
+ * states     - pointer to the array of states (memory allocated by this function)
+ * states_len - length of array of states
+ * err        - error message, if the machine is invalid
+ *
+ * Returns
+ * -------
+ * 0 on success, -1 if the machine is invalid
+ */
+int decode_bbdb(const unsigned char* const rec, const size_t db_states, struct state** const states,
+                size_t* const states_len, char* const err, const size_t err_len) {
+  *states = (struct state *) calloc(db_states, sizeof(struct state));
+  if (*states == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  *states_len = db_states;
+  for (size_t i = 0; i < db_states; ++i) {
+    struct state* const state = *states + i;
+    state->number = i;
+    for (int c = 0; c < 2; ++c) {
+      const unsigned char* const t = rec + 6 * i + 3 * c;
+      struct action* const action = c == 0 ? &(state->action0) : &(state->action1);
+      if (t[0] > 1 || t[1] > 1 || t[2] > db_states) {
+        snprintf(err, err_len, "Invalid machine at byte %zu; invalid transition.", (size_t) (t - rec));
+        free(*states);
+        return -1;
+      }
+      action->value_to_write = t[0];
+      action->next_state = *states;
+      if (t[2] == 0) { // undefined
+        action->direction_to_move = 0;
+        continue;
+      }
+      action->direction_to_move = t[1] == 0 ? +1 : -1;
+      if (link_action(*states, db_states, state, action, t[2] - 1, err, err_len) != 0) {
+        free(*states);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void append_token(struct buffer* const b, const enum token token) {
+  static const char* const encodings[] = { "0", "10", "110", "1110", "11110" };
+  buffer_append(b, encodings[token], token + 1);
+}
+
+/**
+ * Encodes a machine as a canonical minimal Penrose specification, as accepted
+ * by parse_tm(): next state numbers have no leading zeros, prefixes which
+ * parse_tm() treats as implicit are omitted, and STOP always names state 0.
+ * If the last action does not move right, an unreachable state is appended so
+ * that the implicit trailing "110" can be dropped.
+ *
+ * Parameters
+ * ----------
+ * states     - array of states
+ * states_len - length of array of states
+ * err_len    - size of the error message buffer
+ *
+ * "Out" Parameters
+ * ----------------
+ * out - buffer to which the specification is appended
+ * err - error message, if the machine cannot be encoded
+ *
+ * Returns
+ * -------
+ * 0 on success, -1 if the machine cannot be encoded
+ */
+int encode_penrose(const struct state* const states, const size_t states_len, struct buffer* const out,
+                   char* const err, const size_t err_len) {
+  const struct action* const first = &(states[0].action0);
+  if (first->value_to_write != 0 || first->direction_to_move != +1 || first->next_state != states) {
+    snprintf(err, err_len, "Machine cannot be expressed in Penrose's encoding; "
+                           "state 0 must write 0 and move right to state 0 after reading a '0'.");
+    return -1;
+  }
+  // The first action is the implicit leading "110".
+  for (size_t i = 1; i < 2 * states_len; ++i) {
+    const struct action* const action = i % 2 == 0 ? &(states[i / 2].action0) : &(states[i / 2].action1);
+    const size_t next_state_ix = action->direction_to_move == 0 ? 0 : action->next_state->number;
+    if (next_state_ix != 0) {
+      int bits = 0;
+      while (next_state_ix >> bits > 1) {
+        ++bits;
+      }
+      for (; bits >= 0; --bits) {
+        append_token(out, (next_state_ix >> bits) & 1 ? ONE : ZERO);
+      }
+      append_token(out, action->value_to_write == 0 ? ZERO : ONE);
+    } else if (action->value_to_write != 0) {
+      append_token(out, ONE);
+    }
+    append_token(out, action->direction_to_move == +1 ? RIGHT : action->direction_to_move == -1 ? LEFT : STOP);
+  }
+  if (states[states_len - 1].action1.direction_to_move == +1) {
+    out->len -= 3; // the implicit trailing "110"
+  } else {
+    append_token(out, RIGHT); // action0 of the unreachable state; its action1 is implicit
+  }
+  return 0;
+}
+
+/**
+ * Encodes a machine in the standard transition-table text format. Actions
+ * which STOP after writing 0 become "---" and those writing 1 become "1RZ".
+ *
+ * Parameters
+ * ----------
+ * states     - array of states
+ * states_len - length of array of states
+ * err_len    - size of the error message buffer
+ *
+ * "Out" Parameters
+ * ----------------
+ * out - buffer to which the machine is appended
+ * err - error message, if the machine cannot be encoded
+ *
+ * Returns
+ * -------
+ * 0 on success, -1 if the machine cannot be encoded
+ */
+int encode_standard(const struct state* const states, const size_t states_len, struct buffer* const out,
+                    char* const err, const size_t err_len) {
+  if (states_len > 25) { // 'Z' is reserved for halting
+    snprintf(err, err_len, "Machine cannot be expressed in the standard format; it has more than 25 states.");
+    return -1;
+  }
+  for (size_t i = 0; i < states_len; ++i) {
+    if (i > 0) {
+      buffer_append(out, "_", 1);
+    }
+    for (int c = 0; c < 2; ++c) {
+      const struct action* const action = c == 0 ? &(states[i].action0) : &(states[i].action1);
+      char t[3];
+      if (action->direction_to_move == 0) {
+        memcpy(t, action->value_to_write == 0 ? "---" : "1RZ", 3);
+      } else {
+        t[0] = action->value_to_write == 0 ? '0' : '1';
+        t[1] = action->direction_to_move == +1 ? 'R' : 'L';
+        t[2] = 'A' + action->next_state->number;
+      }
+      buffer_append(out, t, 3);
+    }
+  }
+  return 0;
+}
+
+/**
+ * Encodes a machine in the fixed-width binary seed-database format. Actions
+ * which STOP become undefined transitions, keeping the value written.
+ * Machines with fewer than db_states states are padded with undefined states.
+ *
+ * Parameters
+ * ----------
+ * states     - array of states
+ * states_len - length of array of states
+ * db_states  - number of states per record
+ * err_len    - size of the error message buffer
+ *
+ * "Out" Parameters
+ * ----------------
+ * out - buffer to which the record is appended
+ * err - error message, if the machine cannot be encoded
+ *
+ * Returns
+ * -------
+ * 0 on success, -1 if the machine cannot be encoded
+ */
+int encode_bbdb(const struct state* const states, const size_t states_len, const size_t db_states,
+                struct buffer* const out, char* const err, const size_t err_len) {
+  if (states_len > db_states) {
+    snprintf(err, err_len, "Machine cannot be expressed in the seed-database format; "
+                           "it has more than %zu states.", db_states);
+    return -1;
+  }
+  for (size_t i = 0; i < db_states; ++i) {
+    for (int c = 0; c < 2; ++c) {
+      unsigned char t[3] = {0};
+      if (i < states_len) {
+        const struct action* const action = c == 0 ? &(states[i].action0) : &(states[i].action1);
+        t[0] = action->value_to_write;
+        if (action->direction_to_move != 0) {
+          t[1] = action->direction_to_move == +1 ? 0 : 1;
+          t[2] = action->next_state->number + 1;
+        }
+      }
+      buffer_append(out, t, 3);
+    }
+  }
+  return 0;
+}
+
+static void add_convert_error(struct convert_chunk* const chunk, const size_t record, const char* const msg) {
+  if (chunk->errors_len == chunk->errors_cap) {
+    chunk->errors_cap = chunk->errors_cap > 0 ? 2 * chunk->errors_cap : 16;
+    chunk->errors = (struct convert_error *) realloc(chunk->errors, chunk->errors_cap * sizeof(struct convert_error));
+    if (chunk->errors == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+  }
+  struct convert_error* const e = chunk->errors + chunk->errors_len++;
+  e->record = record;
+  snprintf(e->msg, sizeof(e->msg), "%s", msg);
+}
+
+static void convert_record(const struct conversion* const c, struct convert_chunk* const chunk,
+                           const char* const rec, const size_t len,
+                           const char* const name, const size_t name_len) {
+  char err[256];
+  struct state* states;
+  size_t states_len;
+  int rc;
+  switch (c->opts->from) {
+    case FORMAT_PENROSE:
+      rc = tm_parse(rec, len, &states, &states_len, err, sizeof(err));
+      break;
+    case FORMAT_STANDARD:
+      rc = decode_standard(rec, len, &states, &states_len, err, sizeof(err));
+      break;
+    case FORMAT_BBDB:
+      rc = decode_bbdb((const unsigned char *) rec, c->opts->db_states, &states, &states_len, err, sizeof(err));
+      break;
+    default:
+      rc = bundle_load(&(c->bundle), (const struct bundle_entry *) rec - c->bundle.entries, NULL,
+                       &states, &states_len, err, sizeof(err));
+      break;
+  }
+  if (rc != 0) {
+    add_convert_error(chunk, chunk->records, err);
+    return;
+  }
+  const size_t out_len = chunk->out.len;
+  if (name != NULL && c->opts->to != FORMAT_BBDB && c->opts->to != FORMAT_BUNDLE) {
+    buffer_append(&(chunk->out), name, name_len);
+    buffer_append(&(chunk->out), "\t", 1);
+  }
+  switch (c->opts->to) {
+    case FORMAT_PENROSE:
+      rc = encode_penrose(states, states_len, &(chunk->out), err, sizeof(err));
+      break;
+    case FORMAT_STANDARD:
+      rc = encode_standard(states, states_len, &(chunk->out), err, sizeof(err));
+      break;
+    case FORMAT_BBDB:
+      rc = encode_bbdb(states, states_len, c->opts->db_states, &(chunk->out), err, sizeof(err));
+      break;
+    default: {
+      struct bundle_entry entry;
+      entry.table_offset = chunk->out.len; // relative to the chunk until written
+      entry.name_offset = chunk->names.len;
+      entry.states_len = states_len;
+      entry.name_len = name != NULL ? name_len : BUNDLE_UNNAMED;
+      encode_bundle_table(states, states_len, &(chunk->out));
+      buffer_append(&(chunk->entries), &entry, sizeof(entry));
+      if (name != NULL) {
+        buffer_append(&(chunk->names), name, name_len);
+      }
+      rc = 0;
+      break;
+    }
+  }
+  free(states);
+  if (rc != 0) {
+    chunk->out.len = out_len;
+    add_convert_error(chunk, chunk->records, err);
+    return;
+  }
+  if (c->opts->to == FORMAT_PENROSE || c->opts->to == FORMAT_STANDARD) {
+    buffer_append(&(chunk->out), "\n", 1);
+  }
+  ++chunk->converted;
+}
+
+static void* convert_worker(void* const arg) {
+  const struct worker* const w = (const struct worker *) arg;
+  struct conversion* const c = (struct conversion *) w->arg;
+  size_t ix;
+  while ((ix = __atomic_fetch_add(&(c->next_chunk), 1, __ATOMIC_RELAXED)) < c->chunks_len) {
+    struct convert_chunk* const chunk = c->chunks + ix;
+    if (c->opts->from == FORMAT_BBDB || c->opts->from == FORMAT_BUNDLE) {
+      for (const char* rec = chunk->start; rec < chunk->start + chunk->len; rec += c->record_len) {
+        const char* name = NULL;
+        size_t name_len = 0;
+        if (c->opts->from == FORMAT_BUNDLE) {
+          name = bundle_name(&(c->bundle), (const struct bundle_entry *) rec - c->bundle.entries, &name_len);
+        }
+        convert_record(c, chunk, rec, c->record_len, name, name_len);
+        ++chunk->records;
+      }
+      continue;
+    }
+    const char* const end = chunk->start + chunk->len;
+    for (const char* rec = chunk->start; rec < end; ) {
+      const char* eol = (const char *) memchr(rec, '\n', end - rec);
+      if (eol == NULL) {
+        eol = end;
+      }
+      size_t len = eol - rec;
+      if (len > 0 && rec[len - 1] == '\r') {
+        --len;
+      }
+      // Lines may be prefixed by a name and a tab.
+      const char* const tab = (const char *) memchr(rec, '\t', len);
+      const char* const name = tab != NULL ? rec : NULL;
+      const size_t name_len = tab != NULL ? (size_t) (tab - rec) : 0;
+      const char* const machine = tab != NULL ? tab + 1 : rec;
+      const size_t machine_len = len - (machine - rec);
+      if (len > 0 || c->opts->from == FORMAT_PENROSE) { // an empty Penrose specification is valid
+        convert_record(c, chunk, machine, machine_len, name, name_len);
+      }
+      ++chunk->records;
+      rec = eol + 1;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Converts a file of machines between formats. Text formats hold one machine
+ * per line, optionally prefixed by a name and a tab; names are carried over to
+ * text and bundle output. The seed-database format is a 30-byte header
+ * followed by fixed-width records. The input is memory-mapped and split into
+ * chunks which are converted in parallel and written in order. Machines which
+ * cannot be converted are reported and skipped.
+ *
+ * Parameters
+ * ----------
+ * opts - conversion options
+ *
+ * Returns
+ * -------
+ * exit status: 0 if every machine was converted, 1 otherwise
+ */
+int convert(const struct convert_options* const opts) {
+  struct conversion c = {0};
+  c.opts = opts;
+  size_t input_len = 0;
+  const char* input = NULL;
+  const char* data;
+  size_t data_len;
+  if (opts->from == FORMAT_BUNDLE) {
+    open_bundle(opts->input, &(c.bundle));
+    c.record_len = sizeof(struct bundle_entry);
+    data = (const char *) c.bundle.entries;
+    data_len = c.bundle.header->machines_len * c.record_len;
+  } else {
+    input = map_file(opts->input, &input_len);
+    data = input;
+    data_len = input_len;
+  }
+  if (opts->from == FORMAT_BBDB) {
+    c.record_len = 6 * opts->db_states;
+    if (input_len < BBDB_HEADER_LEN || (input_len - BBDB_HEADER_LEN) % c.record_len != 0) {
+      fprintf(stderr, "Invalid seed database %s; expected a %d-byte header and %zu-byte records.\n",
+              opts->input, BBDB_HEADER_LEN, c.record_len);
+      exit(1);
+    }
+    data += BBDB_HEADER_LEN;
+    data_len -= BBDB_HEADER_LEN;
+  }
+
+  // Split the input into chunks on record boundaries, several per thread to
+  // balance the load.
+  size_t chunk_len = data_len / (8 * opts->threads) + 1;
+  if (chunk_len < CONVERT_MIN_CHUNK_LEN) {
+    chunk_len = CONVERT_MIN_CHUNK_LEN;
+  }
+  if (c.record_len != 0) {
+    chunk_len += c.record_len - chunk_len % c.record_len;
+  }
+  c.chunks = (struct convert_chunk *) calloc(data_len / chunk_len + 1, sizeof(struct convert_chunk));
+  if (c.chunks == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  for (const char* start = data; start < data + data_len; ) {
+    const char* end = start + chunk_len < data + data_len ? start + chunk_len : data + data_len;
+    if (c.record_len == 0 && end < data + data_len) {
+      const char* const eol = (const char *) memchr(end, '\n', data + data_len - end);
+      end = eol == NULL ? data + data_len : eol + 1;
+    }
+    c.chunks[c.chunks_len].start = start;
+    c.chunks[c.chunks_len].len = end - start;
+    ++c.chunks_len;
+    start = end;
+  }
+
+  run_workers(opts->threads, convert_worker, &c);
+
+  FILE* const fp = opts->output ? fopen(opts->output, "w") : stdout;
+  if (fp == NULL) {
+    fprintf(stderr, "Error opening file %s.\n", opts->output);
+    exit(1);
+  }
+  size_t records = 0;
+  size_t converted = 0;
+  size_t failed = 0;
+  for (size_t i = 0; i < c.chunks_len; ++i) {
+    converted += c.chunks[i].converted;
+    failed += c.chunks[i].errors_len;
+  }
+  if (opts->to == FORMAT_BBDB) {
+    unsigned char header[BBDB_HEADER_LEN] = {0};
+    for (int i = 0; i < 4; ++i) {
+      header[8 + i] = (unsigned char) (converted >> (8 * (3 - i))); // total number of machines, big-endian
+    }
+    fwrite(header, 1, sizeof(header), fp);
+  }
+  if (opts->to == FORMAT_BUNDLE) {
+    write_bundle(fp, &c, converted);
+  }
+  for (size_t i = 0; i < c.chunks_len; ++i) {
+    struct convert_chunk* const chunk = c.chunks + i;
+    if (opts->to != FORMAT_BUNDLE) {
+      fwrite(chunk->out.data, 1, chunk->out.len, fp);
+    }
+    for (size_t j = 0; j < chunk->errors_len; ++j) {
+      if (c.record_len != 0) {
+        fprintf(stderr, "Machine %zu: %s\n", records + chunk->errors[j].record, chunk->errors[j].msg);
+      } else {
+        fprintf(stderr, "Line %zu: %s\n", records + chunk->errors[j].record + 1, chunk->errors[j].msg);
+      }
+    }
+    records += chunk->records;
+    free(chunk->out.data);
+    free(chunk->entries.data);
+    free(chunk->names.data);
+    free(chunk->errors);
+  }
+  if (fp != stdout && fclose(fp) != 0) {
+    fprintf(stderr, "Error writing file %s.\n", opts->output);
+    exit(1);
+  }
+  free(c.chunks);
+  if (input != NULL) {
+    munmap((void *) input, input_len);
+  }
+  if (c.bundle.data != NULL) {
+    munmap((void *) c.bundle.data, c.bundle.len);
+  }
+  return failed == 0 ? 0 : 1;
+}
+
+/**
+ * Appends the compiled transition table of a machine to a buffer, in the
+ * layout used by bundle files.
+ */
+void encode_bundle_table(const struct state* const states, const size_t states_len, struct buffer* const out) {
+  for (size_t i = 0; i < states_len; ++i) {
+    for (int c = 0; c < 2; ++c) {
+      const struct action* const action = c == 0 ? &(states[i].action0) : &(states[i].action1);
+      struct bundle_action a = {0};
+      a.next_state = action->next_state->number;
+      a.value_to_write = action->value_to_write;
+      a.direction_to_move = action->direction_to_move;
+      buffer_append(out, &a, sizeof(a));
+    }
+  }
+}
+
+// A bundle machine name, used to sort the name index.
+struct bundle_name_ref {
+  const char* name;
+  size_t name_len;
+  uint64_t ix;
+};
+
+static int compare_names(const char* const a, const size_t a_len, const char* const b, const size_t b_len) {
+  const int c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  return c != 0 ? c : a_len < b_len ? -1 : a_len > b_len ? 1 : 0;
+}
+
+static int compare_bundle_name_refs(const void* const a, const void* const b) {
+  const struct bundle_name_ref* const x = (const struct bundle_name_ref *) a;
+  const struct bundle_name_ref* const y = (const struct bundle_name_ref *) b;
+  const int c = compare_names(x->name, x->name_len, y->name, y->name_len);
+  return c != 0 ? c : x->ix < y->ix ? -1 : 1;
+}
+
+/**
+ * Writes the converted machines of a conversion as a bundle file: a header,
+ * the machine index, the index sorted by name, the transition tables and the
+ * names. Machines without a name are named by their index.
+ *
+ * Parameters
+ * ----------
+ * fp       - output stream
+ * c        - completed conversion
+ * machines - number of converted machines
+ */
+void write_bundle(FILE* const fp, const struct conversion* const c, const size_t machines) {
+  struct bundle_name_ref* const refs = (struct bundle_name_ref *) calloc(machines + 1, sizeof(struct bundle_name_ref));
+  struct bundle_entry* const entries = (struct bundle_entry *) calloc(machines + 1, sizeof(struct bundle_entry));
+  if (refs == NULL || entries == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  size_t tables_len = 0;
+  size_t names_len = 0;
+  for (size_t i = 0; i < c->chunks_len; ++i) {
+    tables_len += c->chunks[i].out.len;
+    names_len += c->chunks[i].names.len;
+  }
+  const uint64_t entries_offset = sizeof(struct bundle_header);
+  const uint64_t by_name_offset = entries_offset + machines * sizeof(struct bundle_entry);
+  const uint64_t tables_offset = by_name_offset + machines * sizeof(uint64_t);
+  const uint64_t names_offset = tables_offset + tables_len;
+
+  // Relocate the entries and generate the missing names.
+  struct buffer generated_names = {0};
+  size_t ix = 0;
+  size_t table_base = tables_offset;
+  size_t name_base = names_offset;
+  for (size_t i = 0; i < c->chunks_len; ++i) {
+    const struct convert_chunk* const chunk = c->chunks + i;
+    const struct bundle_entry* const chunk_entries = (const struct bundle_entry *) chunk->entries.data;
+    for (size_t j = 0; j < chunk->converted; ++j, ++ix) {
+      entries[ix] = chunk_entries[j];
+      entries[ix].table_offset += table_base;
+      if (entries[ix].name_len == BUNDLE_UNNAMED) {
+        char name[32];
+        entries[ix].name_len = snprintf(name, sizeof(name), "%zu", ix);
+        entries[ix].name_offset = names_offset + names_len + generated_names.len;
+        buffer_append(&generated_names, name, entries[ix].name_len);
+      } else {
+        refs[ix].name = chunk->names.data + entries[ix].name_offset;
+        entries[ix].name_offset += name_base;
+      }
+      refs[ix].name_len = entries[ix].name_len;
+      refs[ix].ix = ix;
+    }
+    table_base += chunk->out.len;
+    name_base += chunk->names.len;
+  }
+  for (size_t i = 0; i < machines; ++i) {
+    if (refs[i].name == NULL) {
+      refs[i].name = generated_names.data + (entries[i].name_offset - names_offset - names_len);
+    }
+  }
+  qsort(refs, machines, sizeof(struct bundle_name_ref), compare_bundle_name_refs);
+
+  struct bundle_header header = {0};
+  memcpy(header.magic, BUNDLE_MAGIC, sizeof(header.magic));
+  header.machines_len = machines;
+  header.entries_offset = entries_offset;
+  header.by_name_offset = by_name_offset;
+  fwrite(&header, sizeof(header), 1, fp);
+  fwrite(entries, sizeof(struct bundle_entry), machines, fp);
+  for (size_t i = 0; i < machines; ++i) {
+    fwrite(&(refs[i].ix), sizeof(uint64_t), 1, fp);
+  }
+  for (size_t i = 0; i < c->chunks_len; ++i) {
+    fwrite(c->chunks[i].out.data, 1, c->chunks[i].out.len, fp);
+  }
+  for (size_t i = 0; i < c->chunks_len; ++i) {
+    fwrite(c->chunks[i].names.data, 1, c->chunks[i].names.len, fp);
+  }
+  fwrite(generated_names.data, 1, generated_names.len, fp);
+  free(generated_names.data);
+  free(entries);
+  free(refs);
+}
+
+/**
+ * Maps a bundle file and checks its header, exiting with an error message if
+ * it is not a valid bundle.
+ *
+ * Parameters
+ * ----------
+ * f - file name
+ *
+ * "Out" Parameters
+ * ----------------
+ * b - bundle
+ */
+void open_bundle(const char* const f, struct bundle* const b) {
+  b->data = map_file(f, &(b->len));
+  b->header = (const struct bundle_header *) b->data;
+  if (b->len < sizeof(struct bundle_header) || memcmp(b->header->magic, BUNDLE_MAGIC, sizeof(b->header->magic)) != 0
+      || b->header->entries_offset % sizeof(uint64_t) != 0 || b->header->by_name_offset % sizeof(uint64_t) != 0
+      || b->header->machines_len > b->len / sizeof(struct bundle_entry)
+      || b->header->entries_offset > b->len
+      || b->header->machines_len * sizeof(struct bundle_entry) > b->len - b->header->entries_offset
+      || b->header->by_name_offset > b->len
+      || b->header->machines_len * sizeof(uint64_t) > b->len - b->header->by_name_offset) {
+    fprintf(stderr, "Invalid bundle file %s.\n", f);
+    exit(1);
+  }
+  b->entries = (const struct bundle_entry *) (b->data + b->header->entries_offset);
+  b->by_name = (const uint64_t *) (b->data + b->header->by_name_offset);
+  // Batch runs walk the whole bundle.
+  madvise((void *) b->data, b->len, MADV_WILLNEED);
+}
+
+/**
+ * Prepares per-node copies of a bundle for the workers of run_workers(). No
+ * copies are made on a machine with a single NUMA node.
+ *
+ * Parameters
+ * ----------
+ * bundle - bundle, which must outlive the copies
+ *
+ * "Out" Parameters
+ * ----------------
+ * r - copies, to be freed with free_bundle_replicas()
+ */
+void init_bundle_replicas(struct bundle_replicas* const r, const struct bundle* const bundle) {
+  struct numa_topology topo;
+  read_numa_topology(&topo);
+  r->bundle = bundle;
+  r->replicas_len = topo.nodes_len > 1 ? topo.nodes_len : 0;
+  r->replicas = NULL;
+  if (r->replicas_len == 0) {
+    return;
+  }
+  r->replicas = (struct bundle_replica *) calloc(r->replicas_len, sizeof(struct bundle_replica));
+  if (r->replicas == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  for (size_t i = 0; i < r->replicas_len; ++i) {
+    pthread_mutex_init(&(r->replicas[i].lock), NULL);
+  }
+}
+
+/**
+ * Returns the copy of a bundle for a NUMA node, making it on first use.
+ * Since the caller runs on that node, the copy is placed in its memory.
+ *
+ * Parameters
+ * ----------
+ * r    - copies of the bundle
+ * node - node of the calling worker
+ */
+const struct bundle* node_bundle(struct bundle_replicas* const r, const size_t node) {
+  if (node >= r->replicas_len) {
+    return r->bundle;
+  }
+  struct bundle_replica* const replica = r->replicas + node;
+  pthread_mutex_lock(&(replica->lock));
+  if (replica->data == NULL) {
+    const struct bundle* const b = r->bundle;
+    replica->data = (char *) malloc(b->len);
+    if (replica->data == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    memcpy(replica->data, b->data, b->len);
+    replica->bundle.data = replica->data;
+    replica->bundle.len = b->len;
+    replica->bundle.header = (const struct bundle_header *) replica->data;
+    replica->bundle.entries = (const struct bundle_entry *) (replica->data + b->header->entries_offset);
+    replica->bundle.by_name = (const uint64_t *) (replica->data + b->header->by_name_offset);
+  }
+  pthread_mutex_unlock(&(replica->lock));
+  return &(replica->bundle);
+}
+
+/**
+ * Frees the per-node copies of a bundle.
+ */
+void free_bundle_replicas(struct bundle_replicas* const r) {
+  for (size_t i = 0; i < r->replicas_len; ++i) {
+    pthread_mutex_destroy(&(r->replicas[i].lock));
+    free(r->replicas[i].data);
+  }
+  free(r->replicas);
+}
+
+/**
+ * Returns the name of a machine in a bundle.
+ *
+ * Parameters
+ * ----------
+ * b  - bundle
+ * ix - machine index
+ *
+ * "Out" Parameters
+ * ----------------
+ * name_len - length of the name, which is not NUL-terminated
+ */
+const char* bundle_name(const struct bundle* const b, const size_t ix, size_t* const name_len) {
+  const struct bundle_entry* const entry = b->entries + ix;
+  if (entry->name_offset > b->len || entry->name_len > b->len - entry->name_offset) {
+    *name_len = 0;
+    return "";
+  }
+  *name_len = entry->name_len;
+  return b->data + entry->name_offset;
+}
+
+/**
+ * Finds a machine in a bundle by name.
+ *
+ * Returns
+ * -------
+ * index of the first machine with that name, or (size_t) -1 if there is none
+ */
+size_t bundle_find(const struct bundle* const b, const char* const name) {
+  const size_t len = strlen(name);
+  size_t lo = 0;
+  size_t hi = b->header->machines_len;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    size_t mid_len;
+    if (b->by_name[mid] >= b->header->machines_len) {
+      return (size_t) -1;
+    }
+    const char* const mid_name = bundle_name(b, b->by_name[mid], &mid_len);
+    if (compare_names(mid_name, mid_len, name, len) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < b->header->machines_len) {
+    size_t found_len;
+    const char* const found = bundle_name(b, b->by_name[lo], &found_len);
+    if (compare_names(found, found_len, name, len) == 0) {
+      return b->by_name[lo];
+    }
+  }
+  return (size_t) -1;
+}
+
+/**
+ * Materializes a machine from a bundle. No parsing is needed; the transition
+ * table is only checked and linked.
+ *
+ * Parameters
+ * ----------
+ * b       - bundle
+ * ix      - machine index
+ * err_len - size of the error message buffer
+ *
+ * "Out" Parameters
+ * ----------------
+ * states     - pointer to the array of states (memory allocated by this function)
+ * states_len - length of array of states
+ * err        - error message, if the machine is invalid
+ *
+ * Returns
+ * -------
+ * 0 on success, -1 if the machine is invalid
+ */
+int bundle_load(const struct bundle* const b, const size_t ix, struct run_pool* const pool,
+                struct state** const states, size_t* const states_len, char* const err, const size_t err_len) {
+  const struct bundle_entry* const entry = b->entries + ix;
+  const uint64_t table_len = 2 * (uint64_t) entry->states_len * sizeof(struct bundle_action);
+  if (entry->states_len == 0 || entry->table_offset % sizeof(uint32_t) != 0
+      || entry->table_offset > b->len || table_len > b->len - entry->table_offset) {
+    snprintf(err, err_len, "Invalid bundle; machine %zu is truncated.", ix);
+    return -1;
+  }
+  const struct bundle_action* const table = (const struct bundle_action *) (b->data + entry->table_offset);
+  *states_len = entry->states_len;
+  *states = (struct state *) pool_alloc(pool, *states_len * sizeof(struct state));
+  memset(*states, 0, *states_len * sizeof(struct state));
+  for (size_t i = 0; i < *states_len; ++i) {
+    struct state* const state = *states + i;
+    state->number = i;
+    for (int c = 0; c < 2; ++c) {
+      const struct bundle_action* const a = table + 2 * i + c;
+      struct action* const action = c == 0 ? &(state->action0) : &(state->action1);
+      action->value_to_write = a->value_to_write != 0;
+      action->direction_to_move = a->direction_to_move < 0 ? -1 : a->direction_to_move > 0 ? +1 : 0;
+      if (link_action(*states, *states_len, state, action, a->next_state, err, err_len) != 0) {
+        pool_free(pool, *states);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Returns the number of '0's and '1's at the start of a line.
+static size_t tape_prefix_len(const char* const p, const char* const end) {
+  size_t cells = 0;
+  while (p + cells < end && (p[cells] == '0' || p[cells] == '1')) {
+    ++cells;
+  }
+  return cells;
+}
+
+/**
+ * Packs text tapes, one per line, into a tape corpus. Lines that are not
+ * tapes are reported and skipped.
+ *
+ * Parameters
+ * ----------
+ * input  - text file
+ * output - corpus file, or NULL for standard output
+ *
+ * Returns
+ * -------
+ * exit status
+ */
+int pack_tapes(const char* const input, const char* const output) {
+  size_t len;
+  const char* const data = map_file(input, &len);
+  struct buffer entries = {0};
+  uint64_t data_len = 0;
+  size_t line = 0;
+  int status = 0;
+  // First pass: find the tapes, so that the index can be written first.
+  for (const char* p = data; p < data + len; ) {
+    const char* eol = (const char *) memchr(p, '\n', data + len - p);
+    const char* const next = eol == NULL ? data + len : eol + 1;
+    eol = eol == NULL ? data + len : eol;
+    const char* const end = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+    ++line;
+    const size_t cells = tape_prefix_len(p, end);
+    if (p + cells < end) {
+      fprintf(stderr, "Line %zu: invalid tape at index %zu; must consist of 0s and 1s only.\n", line, cells);
+      status = 1;
+    } else {
+      const struct tape_corpus_entry entry = { data_len, cells };
+      buffer_append(&entries, &entry, sizeof(entry));
+      data_len += (cells + 7) / 8;
+    }
+    p = next;
+  }
+
+  FILE* const fp = output ? fopen(output, "w") : stdout;
+  if (fp == NULL) {
+    fprintf(stderr, "Error opening file %s.\n", output);
+    exit(1);
+  }
+  struct tape_corpus_header header = {0};
+  memcpy(header.magic, TAPE_CORPUS_MAGIC, sizeof(header.magic));
+  header.tapes_len = entries.len / sizeof(struct tape_corpus_entry);
+  header.index_offset = sizeof(header);
+  header.data_offset = header.index_offset + entries.len;
+  fwrite(&header, sizeof(header), 1, fp);
+  fwrite(entries.data, 1, entries.len, fp);
+
+  // Second pass: pack the tapes.
+  struct buffer packed = {0};
+  for (const char* p = data; p < data + len; ) {
+    const char* eol = (const char *) memchr(p, '\n', data + len - p);
+    const char* const next = eol == NULL ? data + len : eol + 1;
+    eol = eol == NULL ? data + len : eol;
+    const char* const end = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+    if (p + tape_prefix_len(p, end) == end) {
+      packed.len = 0;
+      for (const char* c = p; c < end; c += 8) {
+        unsigned char byte = 0;
+        for (int i = 0; i < 8 && c + i < end; ++i) {
+          byte |= (unsigned char) ((c[i] - '0') << i);
+        }
+        buffer_append(&packed, &byte, 1);
+      }
+      fwrite(packed.data, 1, packed.len, fp);
+    }
+    p = next;
+  }
+  if (output) {
+    fclose(fp);
+  }
+  free(packed.data);
+  free(entries.data);
+  if (data != NULL) {
+    munmap((void *) data, len);
+  }
+  return status;
+}
+
+/**
+ * Maps a tape corpus file and checks its header, exiting with an error
+ * message if it is not a valid corpus. The tapes themselves are checked as
+ * they are read.
+ *
+ * Parameters
+ * ----------
+ * f - file name
+ *
+ * "Out" Parameters
+ * ----------------
+ * c - corpus
+ */
+void open_tape_corpus(const char* const f, struct tape_corpus* const c) {
+  c->data = map_file(f, &(c->len));
+  c->header = (const struct tape_corpus_header *) c->data;
+  if (c->len < sizeof(struct tape_corpus_header)
+      || memcmp(c->header->magic, TAPE_CORPUS_MAGIC, sizeof(c->header->magic)) != 0
+      || c->header->index_offset % sizeof(uint64_t) != 0
+      || c->header->tapes_len > c->len / sizeof(struct tape_corpus_entry)
+      || c->header->index_offset > c->len
+      || c->header->tapes_len * sizeof(struct tape_corpus_entry) > c->len - c->header->index_offset
+      || c->header->data_offset > c->len) {
+    fprintf(stderr, "Invalid tape corpus file %s.\n", f);
+    exit(1);
+  }
+  c->entries = (const struct tape_corpus_entry *) (c->data + c->header->index_offset);
+  madvise((void *) c->data, c->len, MADV_WILLNEED);
+}
+
+/**
+ * Unpacks a tape from a corpus into a buffer as '0's and '1's followed by a
+ * NUL.
+ *
+ * Parameters
+ * ----------
+ * c  - corpus
+ * ix - tape index, which must be less than the number of tapes
+ *
+ * "Out" Parameters
+ * ----------------
+ * out - tape, replacing the contents of the buffer
+ *
+ * Returns
+ * -------
+ * length of the tape, or -1 if its entry points outside the file
+ */
+ssize_t corpus_tape(const struct tape_corpus* const c, const size_t ix, struct buffer* const out) {
+  const struct tape_corpus_entry* const entry = c->entries + ix;
+  const uint64_t available = c->len - c->header->data_offset;
+  if (entry->offset > available || (entry->len + 7) / 8 > available - entry->offset
+      || entry->len > (uint64_t) SSIZE_MAX - 1) {
+    return -1;
+  }
+  const unsigned char* const packed = (const unsigned char *) c->data + c->header->data_offset + entry->offset;
+  out->len = 0;
+  for (size_t i = 0; i < entry->len; i += 8) {
+    char cells[8];
+    for (int j = 0; j < 8; ++j) {
+      cells[j] = (char) ('0' + ((packed[i / 8] >> j) & 1));
+    }
+    buffer_append(out, cells, entry->len - i < 8 ? entry->len - i : 8);
+  }
+  buffer_append(out, "", 1);
+  return (ssize_t) entry->len;
+}
+
+/**
+ * Prints the tapes in a tape corpus as text, one per line.
+ *
+ * Parameters
+ * ----------
+ * input  - corpus file
+ * output - text file, or NULL for standard output
+ *
+ * Returns
+ * -------
+ * exit status
+ */
+int unpack_tapes(const char* const input, const char* const output) {
+  struct tape_corpus c;
+  open_tape_corpus(input, &c);
+  FILE* const fp = output ? fopen(output, "w") : stdout;
+  if (fp == NULL) {
+    fprintf(stderr, "Error opening file %s.\n", output);
+    exit(1);
+  }
+  struct buffer tape = {0};
+  int status = 0;
+  for (size_t i = 0; i < c.header->tapes_len; ++i) {
+    const ssize_t len = corpus_tape(&c, i, &tape);
+    if (len < 0) {
+      fprintf(stderr, "Tape %zu: invalid tape corpus entry\n", i);
+      status = 1;
+      continue;
+    }
+    tape.data[len] = '\n';
+    fwrite(tape.data, 1, len + 1, fp);
+  }
+  if (output) {
+    fclose(fp);
+  }
+  free(tape.data);
+  return status;
+}
+
+// Starts the next job of a chunk that can run in a lane, writing the lines of
+// any that cannot to their output. Returns zero if there are none left.
+static int start_lane(const struct batch* const b, const struct bundle* const bundle,
+                      const struct run_options* const opts, struct batch_lane* const lane,
+                      struct buffer* const lines, size_t* const next, const size_t end) {
+  const size_t tapes_len = b->corpus ? b->corpus->header->tapes_len : 1;
+  while (*next < end) {
+    const size_t k = (*next)++;
+    struct buffer* const line = lines + k % BATCH_CHUNK_LEN;
+    line->len = 0;
+    size_t name_len;
+    const char* const name = bundle_name(bundle, k / tapes_len, &name_len);
+    buffer_append(line, name, name_len);
+    char err[256];
+    const char* initial_tape = b->tape;
+    ssize_t initial_tape_len = b->tape_len;
+    if (b->corpus) {
+      char ix_str[32];
+      buffer_append(line, ix_str, snprintf(ix_str, sizeof(ix_str), "\t%zu", k % tapes_len));
+      initial_tape_len = corpus_tape(b->corpus, k % tapes_len, &(lane->tape));
+      initial_tape = lane->tape.data;
+    }
+    const int loaded = bundle_load(bundle, k / tapes_len, opts->pool, &(lane->states), &(lane->states_len),
+                                   err, sizeof(err)) == 0;
+    if (!loaded || initial_tape_len < 0) {
+      if (loaded) {
+        pool_free(opts->pool, lane->states);
+      }
+      const char* const msg = !loaded ? err : "invalid tape corpus entry";
+      buffer_append(line, "\tinvalid\t", 9);
+      buffer_append(line, msg, strlen(msg));
+      buffer_append(line, "\n", 1);
+      continue;
+    }
+    lane->job = k;
+    lane->steps = 0;
+    lane->e = opts->engine->create(lane->states, initial_tape, initial_tape_len, opts->max_tape_len, opts->pool);
+    return 1;
+  }
+  lane->e = NULL;
+  return 0;
+}
+
+/**
+ * Runs the jobs of a batch chunk with one worker, advancing up to
+ * b->interleave machines in turn by INTERLEAVE_SLICE steps at a time. After
+ * each slice the cells that machine can reach in its next slice are
+ * prefetched, so that they arrive while the other machines run.
+ *
+ * Parameters
+ * ----------
+ * b      - batch
+ * bundle - the worker's copy of the bundle
+ * opts   - the worker's run options
+ * lanes  - b->interleave idle lanes
+ * first  - first job of the chunk
+ * end    - end of the chunk
+ *
+ * "Out" Parameters
+ * ----------------
+ * lines - output line of each job, indexed by job modulo BATCH_CHUNK_LEN
+ */
+static void run_chunk_interleaved(const struct batch* const b, const struct bundle* const bundle,
+                                  const struct run_options* const opts, struct batch_lane* const lanes,
+                                  struct buffer* const lines, const size_t first, const size_t end) {
+  const struct engine* const engine = opts->engine;
+  size_t next = first;
+  size_t active = 0;
+  for (size_t i = 0; i < b->interleave; ++i) {
+    active += start_lane(b, bundle, opts, lanes + i, lines, &next, end);
+  }
+  while (active > 0) {
+    for (size_t i = 0; i < b->interleave; ++i) {
+      struct batch_lane* const lane = lanes + i;
+      if (lane->e == NULL) {
+        continue;
+      }
+      const unsigned long long n = opts->max_steps - lane->steps < INTERLEAVE_SLICE
+                                   ? opts->max_steps - lane->steps : INTERLEAVE_SLICE;
+      const enum status status = engine->advance(lane->e, n);
+      lane->steps += n;
+      if (status == RUNNING && lane->steps < opts->max_steps) {
+        if (engine->prefetch != NULL) {
+          engine->prefetch(lane->e, INTERLEAVE_SLICE);
+        }
+        continue;
+      }
+      struct buffer* const line = lines + lane->job % BATCH_CHUNK_LEN;
+      if (status == HALTED) {
+        struct run_info info;
+        engine->get_info(lane->e, &info);
+        buffer_append(line, "\thalted\t", 8);
+        append_result(engine, lane->e, &info, opts->pool, line);
+      } else if (status == TAPE_LIMIT) {
+        buffer_append(line, "\tmax-tape-length", 16);
+      } else {
+        buffer_append(line, "\tmax-steps", 10);
+      }
+      buffer_append(line, "\n", 1);
+      engine->destroy(lane->e);
+      pool_free(opts->pool, lane->states);
+      if (!start_lane(b, bundle, opts, lane, lines, &next, end)) {
+        --active;
+      }
+    }
+  }
+}
+
+static void* batch_worker(void* const arg) {
+  const struct worker* const w = (const struct worker *) arg;
+  struct batch* const b = (struct batch *) w->arg;
+  const struct bundle* const bundle = node_bundle(&(b->replicas), w->node);
+  const size_t tapes_len = b->corpus ? b->corpus->header->tapes_len : 1;
+  struct run_pool pool = {0};
+  struct run_options opts = *(b->opts);
+  opts.pool = &pool;
+  struct buffer result = {0};
+  struct buffer tape = {0};
+  struct batch_lane* lanes = NULL;
+  struct buffer* lines = NULL;
+  if (b->interleave > 1) {
+    lanes = (struct batch_lane *) calloc(b->interleave, sizeof(struct batch_lane));
+    lines = (struct buffer *) calloc(BATCH_CHUNK_LEN, sizeof(struct buffer));
+    if (lanes == NULL || lines == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+  }
+  // The machine loaded last, which is run on consecutive tapes.
+  size_t loaded = (size_t) -1;
+  struct state* states = NULL;
+  size_t states_len = 0;
+  char err[256];
+  // Claims chunks from the worker's own node first, then from the others.
+  for (size_t r = 0; r < b->ranges_len; ++r) {
+    struct batch_range* const range = b->ranges + (w->node + r) % b->ranges_len;
+    size_t ix;
+    while ((ix = __atomic_fetch_add(&(range->next_chunk), 1, __ATOMIC_RELAXED)) < range->end) {
+      struct buffer* const out = b->outs + ix;
+      const size_t end = (ix + 1) * BATCH_CHUNK_LEN < b->jobs_len ? (ix + 1) * BATCH_CHUNK_LEN : b->jobs_len;
+      if (lanes != NULL) {
+        run_chunk_interleaved(b, bundle, &opts, lanes, lines, ix * BATCH_CHUNK_LEN, end);
+        for (size_t k = ix * BATCH_CHUNK_LEN; k < end; ++k) {
+          buffer_append(out, lines[k % BATCH_CHUNK_LEN].data, lines[k % BATCH_CHUNK_LEN].len);
+        }
+        continue;
+      }
+      for (size_t k = ix * BATCH_CHUNK_LEN; k < end; ++k) {
+        const size_t m = k / tapes_len;
+        size_t name_len;
+        const char* const name = bundle_name(bundle, m, &name_len);
+        buffer_append(out, name, name_len);
+        if (m != loaded) {
+          pool_free(&pool, states);
+          loaded = m;
+          if (bundle_load(bundle, m, &pool, &states, &states_len, err, sizeof(err)) != 0) {
+            states = NULL;
+          }
+        }
+        const char* initial_tape = b->tape;
+        ssize_t initial_tape_len = b->tape_len;
+        if (b->corpus) {
+          char ix_str[32];
+          buffer_append(out, ix_str, snprintf(ix_str, sizeof(ix_str), "\t%zu", k % tapes_len));
+          initial_tape_len = corpus_tape(b->corpus, k % tapes_len, &tape);
+          initial_tape = tape.data;
+        }
+        if (states == NULL || initial_tape_len < 0) {
+          const char* const msg = states == NULL ? err : "invalid tape corpus entry";
+          buffer_append(out, "\tinvalid\t", 9);
+          buffer_append(out, msg, strlen(msg));
+          buffer_append(out, "\n", 1);
+          continue;
+        }
+        struct run_info info;
+        result.len = 0;
+        const enum status status = run_machine(states, states_len, initial_tape, initial_tape_len, &opts, &info,
+                                               &result);
+        if (status == HALTED) {
+          buffer_append(out, "\thalted\t", 8);
+          buffer_append(out, result.data, result.len);
+        } else if (status == TAPE_LIMIT) {
+          buffer_append(out, "\tmax-tape-length", 16);
+        } else {
+          buffer_append(out, "\tmax-steps", 10);
+        }
+        buffer_append(out, "\n", 1);
+      }
+    }
+  }
+  pool_free(&pool, states);
+  for (size_t i = 0; lanes != NULL && i < b->interleave; ++i) {
+    free(lanes[i].tape.data);
+  }
+  for (size_t i = 0; lines != NULL && i < BATCH_CHUNK_LEN; ++i) {
+    free(lines[i].data);
+  }
+  free(lanes);
+  free(lines);
+  __atomic_add_fetch(&(b->allocs), pool.allocs, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&(b->reuses), pool.reuses, __ATOMIC_RELAXED);
+  destroy_pool(&pool);
+  free(tape.data);
+  free(result.data);
+  return NULL;
+}
+
+/**
+ * Runs every machine in a bundle on the same tape, printing one line per
+ * machine in bundle order: the machine name, then "halted" and the result,
+ * "max-steps", "max-tape-length" or "invalid" and an error message,
+ * separated by tabs. Machines are read directly from the mapped bundle and
+ * run by worker threads in chunks. With a tape corpus, every machine is run
+ * on every tape in turn, and the index of the tape follows the name.
+ *
+ * Parameters
+ * ----------
+ * bundle  - bundle
+ * tape    - initial tape, if there is no corpus
+ * corpus  - tape corpus, or NULL
+ * opts    - run options; verbosity is ignored
+ * threads - number of worker threads
+ * interleave - number of machines each worker runs at once, taking turns
+ *
+ * Returns
+ * -------
+ * exit status
+ */
+int run_batch(const struct bundle* const bundle, const char* const tape, const struct tape_corpus* const corpus,
+              const struct run_options* const opts, const size_t threads, const size_t interleave) {
+  struct batch b = {0};
+  b.interleave = interleave;
+  b.bundle = bundle;
+  b.corpus = corpus;
+  if (corpus == NULL) {
+    b.tape = tape;
+    b.tape_len = check_tape(tape);
+  }
+  b.opts = opts;
+  b.jobs_len = bundle->header->machines_len * (corpus ? corpus->header->tapes_len : 1);
+  b.chunks_len = (b.jobs_len + BATCH_CHUNK_LEN - 1) / BATCH_CHUNK_LEN;
+  b.outs = (struct buffer *) calloc(b.chunks_len + 1, sizeof(struct buffer));
+  init_bundle_replicas(&(b.replicas), bundle);
+  // One range of chunks per node that has workers.
+  b.ranges_len = b.replicas.replicas_len == 0 ? 1
+                 : threads < b.replicas.replicas_len ? threads : b.replicas.replicas_len;
+  b.ranges = (struct batch_range *) calloc(b.ranges_len, sizeof(struct batch_range));
+  if (b.outs == NULL || b.ranges == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  for (size_t i = 0; i < b.ranges_len; ++i) {
+    b.ranges[i].next_chunk = b.chunks_len * i / b.ranges_len;
+    b.ranges[i].end = b.chunks_len * (i + 1) / b.ranges_len;
+  }
+
+  run_workers(threads, batch_worker, &b);
+
+  for (size_t i = 0; i < b.chunks_len; ++i) {
+    fwrite(b.outs[i].data, 1, b.outs[i].len, stdout);
+    free(b.outs[i].data);
+  }
+  free(b.outs);
+  free(b.ranges);
+  free_bundle_replicas(&(b.replicas));
+  if (opts->stats) {
+    print_pool_stats(b.allocs, b.reuses);
+  }
+  return 0;
+}
+
+/**
+ * Compares two unsigned long longs, for qsort().
+ */
+int compare_ulls(const void* const a, const void* const b) {
+  const unsigned long long x = *(const unsigned long long *) a;
+  const unsigned long long y = *(const unsigned long long *) b;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/**
+ * Hashes a configuration (excluding the step number) with 64-bit FNV-1a.
+ */
+uint64_t snapshot_hash(const struct snapshot* const snap) {
+  const int64_t fields[] = {
+    (int64_t) snap->info.state->number, snap->info.head, snap->info.min_pos, snap->info.max_pos
+  };
+  const uint64_t h = fnv1a(14695981039346656037ull, fields, sizeof(fields));
+  return fnv1a(h, snap->cells, snap->info.max_pos - snap->info.min_pos + 1);
+}
+
+/**
+ * Writes a configuration line of a certificate: the step, the hash of the
+ * configuration, the state number in hexadecimal, the head position, the
+ * position of the first cell, and the cells with ' ' for blanks.
+ */
+void write_certificate_config(FILE* const fp, const struct snapshot* const snap) {
+  fprintf(fp, "config %llu %016llx %zX %zd %zd ", snap->info.step, (unsigned long long) snapshot_hash(snap),
+          snap->info.state->number, snap->info.head, snap->info.min_pos);
+  fwrite(snap->cells, 1, snap->info.max_pos - snap->info.min_pos + 1, fp);
+  fputc('\n', fp);
+}
+
+/**
+ * Starts a certificate: opens the file and writes the machine and the tape.
+ *
+ * Parameters
+ * ----------
+ * cw           - certificate being written
+ * states       - Turing machine states
+ * initial_tape - initial tape
+ */
+void begin_certificate(struct certificate_writer* const cw, const struct state* const states,
+                       const char* const initial_tape) {
+  struct buffer spec = {0};
+  char err[256];
+  if (encode_penrose(states, cw->states_len, &spec, err, sizeof(err)) != 0) {
+    fprintf(stderr, "Cannot write certificate. %s\n", err);
+    exit(1);
+  }
+  cw->fp = fopen(cw->path, "w");
+  if (cw->fp == NULL) {
+    fprintf(stderr, "Error opening file %s.\n", cw->path);
+    exit(1);
+  }
+  fputs("penrose-turing certificate 1\nmachine ", cw->fp);
+  fwrite(spec.data, 1, spec.len, cw->fp);
+  fprintf(cw->fp, "\ntape %s\n", initial_tape);
+  free(spec.data);
+}
+
+/**
+ * Completes a certificate. A halting run has already recorded its
+ * configurations, so only the number of steps is added. Otherwise the
+ * configurations are discarded and a non-halting witness is searched for;
+ * if none is found within the step limit, the certificate is removed.
+ *
+ * Parameters
+ * ----------
+ * cw               - certificate being written
+ * states           - Turing machine states
+ * initial_tape     - initial tape
+ * initial_tape_len - initial tape length
+ * status           - outcome of the run
+ * info             - final position of the run
+ */
+void end_certificate(struct certificate_writer* const cw, const struct state* const states,
+                     const char* const initial_tape, const size_t initial_tape_len,
+                     const enum status status, const struct run_info* const info) {
+  if (status == HALTED) {
+    fprintf(cw->fp, "halts %llu\n", info->step);
+  } else {
+    fclose(cw->fp);
+    struct buffer witness = {0};
+    if (!find_nonhalting_witness(states, cw->states_len, initial_tape, initial_tape_len, info->step, &witness)) {
+      fprintf(stderr, "No certificate written; no non-halting witness found within %llu steps.\n", info->step);
+      remove(cw->path);
+      free(cw->snap.cells);
+      return;
+    }
+    begin_certificate(cw, states, initial_tape);
+    fwrite(witness.data, 1, witness.len, cw->fp);
+    free(witness.data);
+  }
+  if (fclose(cw->fp) != 0) {
+    fprintf(stderr, "Error writing file %s.\n", cw->path);
+    exit(1);
+  }
+  free(cw->snap.cells);
+}
+
+/**
+ * Searches for evidence that a machine never halts, by running it on the
+ * reference engine for up to max_steps steps. Two kinds of witness are
+ * recognized:
+ *
+ * - "cycle A P": the configuration after step A recurs after step A + P.
+ *   Cycles are found with Brent's algorithm.
+ * - "escape A D S...": a set of states S, closed under reading a blank, in
+ *   which every state moves in direction D on reading a blank. After step A
+ *   the machine is in S with the head on a blank cell beyond every written
+ *   cell in direction D, so it moves in direction D forever.
+ *
+ * Parameters
+ * ----------
+ * states           - Turing machine states
+ * states_len       - length of array of states
+ * initial_tape     - initial tape
+ * initial_tape_len - initial tape length
+ * max_steps        - maximum number of steps to search
+ *
+ * "Out" Parameters
+ * ----------------
+ * out - the witness line is appended to out
+ *
+ * Returns
+ * -------
+ * non-zero if a witness was found
+ */
+int find_nonhalting_witness(const struct state* const states, const size_t states_len,
+                            const char* const initial_tape, const size_t initial_tape_len,
+                            const unsigned long long max_steps, struct buffer* const out) {
+  // escapes[0] holds the greatest closed set of states moving right on a
+  // blank, escapes[1] the same for moving left.
+  char* const escapes[2] = { (char *) calloc(states_len, 1), (char *) calloc(states_len, 1) };
+  if (escapes[0] == NULL || escapes[1] == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  for (int d = 0; d < 2; ++d) {
+    for (size_t i = 0; i < states_len; ++i) {
+      escapes[d][i] = states[i].action0.direction_to_move == (d == 0 ? +1 : -1);
+    }
+    for (int changed = 1; changed; ) {
+      changed = 0;
+      for (size_t i = 0; i < states_len; ++i) {
+        if (escapes[d][i] && !escapes[d][states[i].action0.next_state->number]) {
+          escapes[d][i] = 0;
+          changed = 1;
+        }
+      }
+    }
+  }
+
+  const struct engine* const reference = find_engine("reference");
+  void* const e = reference->create(states, initial_tape, initial_tape_len, (size_t) -1, NULL);
+  struct snapshot saved = {0};
+  struct snapshot curr = {0};
+  take_snapshot(reference, e, &saved);
+  unsigned long long power = 1;
+  int found = 0;
+  struct run_info info;
+  reference->get_info(e, &info);
+  while (!found && info.step <= max_steps) {
+    for (int d = 0; d < 2 && !found; ++d) {
+      if (escapes[d][info.state->number] && info.head == (d == 0 ? info.max_pos : info.min_pos)) {
+        char c;
+        reference->read_cells(e, info.head, 1, &c);
+        if (c == ' ') {
+          char line[64];
+          buffer_append(out, line, snprintf(line, sizeof(line), "escape %llu %d", info.step, d == 0 ? +1 : -1));
+          for (size_t i = 0; i < states_len; ++i) {
+            if (escapes[d][i]) {
+              buffer_append(out, line, snprintf(line, sizeof(line), " %zX", i));
+            }
+          }
+          buffer_append(out, "\n", 1);
+          found = 1;
+        }
+      }
+    }
+    if (!found && info.step > saved.info.step && info.state == saved.info.state && info.head == saved.info.head
+        && info.min_pos == saved.info.min_pos && info.max_pos == saved.info.max_pos) {
+      take_snapshot(reference, e, &curr);
+      if (memcmp(curr.cells, saved.cells, info.max_pos - info.min_pos + 1) == 0) {
+        char line[64];
+        buffer_append(out, line, snprintf(line, sizeof(line), "cycle %llu %llu\n",
+                                          saved.info.step, info.step - saved.info.step));
+        found = 1;
+      }
+    }
+    if (info.step - saved.info.step == power) {
+      take_snapshot(reference, e, &saved);
+      power *= 2;
+    }
+    if (found || reference->advance(e, 1) != RUNNING) {
+      break;
+    }
+    reference->get_info(e, &info);
+  }
+  reference->destroy(e);
+  free(saved.cells);
+  free(curr.cells);
+  free(escapes[0]);
+  free(escapes[1]);
+  return found;
+}
+
+// Marks a certificate as invalid; only the first reason is kept.
+static void reject_certificate(struct certificate* const cert, const char* const reason) {
+  int expected = 0;
+  if (__atomic_compare_exchange_n(&(cert->failed), &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    snprintf(cert->reason, sizeof(cert->reason), "%s", reason);
+  }
+}
+
+static int same_configuration(const struct snapshot* const a, const struct snapshot* const b) {
+  return a->info.state == b->info.state && a->info.head == b->info.head
+      && a->info.min_pos == b->info.min_pos && a->info.max_pos == b->info.max_pos
+      && memcmp(a->cells, b->cells, a->info.max_pos - a->info.min_pos + 1) == 0;
+}
+
+// Verifies one segment of a halting certificate: the recorded configuration
+// at the start of the segment, run on the reference engine, must reach the
+// recorded configuration at its end, halting exactly there if it is the last.
+static void verify_segment(struct certificate* const cert, const size_t i) {
+  const struct engine* const reference = find_engine("reference");
+  const struct snapshot* const from = cert->configs + i;
+  const struct snapshot* const to = cert->configs + i + 1;
+  char reason[128];
+  if (snapshot_hash(from) != cert->hashes[i] || snapshot_hash(to) != cert->hashes[i + 1]) {
+    snprintf(reason, sizeof(reason), "hash mismatch in segment %zu", i);
+    reject_certificate(cert, reason);
+    return;
+  }
+  struct snapshot snap = {0};
+  if (i == 0) {
+    void* const e = reference->create(cert->states, cert->tape, cert->tape_len, (size_t) -1, NULL);
+    take_snapshot(reference, e, &snap);
+    reference->destroy(e);
+    if (!same_configuration(&snap, from)) {
+      reject_certificate(cert, "first configuration is not the initial configuration");
+      free(snap.cells);
+      return;
+    }
+  }
+  void* const e = reference_restore(cert->states, from);
+  const enum status status = reference->advance(e, to->info.step - from->info.step);
+  take_snapshot(reference, e, &snap);
+  reference->destroy(e);
+  const int last = i + 2 == cert->configs_len;
+  if (status != (last ? HALTED : RUNNING) || snap.info.step != to->info.step || !same_configuration(&snap, to)) {
+    snprintf(reason, sizeof(reason), "segment %zu does not reach the recorded configuration at step %llu",
+             i, to->info.step);
+    reject_certificate(cert, reason);
+  }
+  free(snap.cells);
+}
+
+// Verifies a non-halting certificate.
+static void verify_nonhalting(struct certificate* const cert) {
+  const struct engine* const reference = find_engine("reference");
+  void* const e = reference->create(cert->states, cert->tape, cert->tape_len, (size_t) -1, NULL);
+  struct snapshot first = {0};
+  struct snapshot second = {0};
+  if (reference->advance(e, cert->a) != RUNNING) {
+    reject_certificate(cert, "the machine halts");
+  } else if (cert->kind == CERTIFICATE_CYCLE) {
+    take_snapshot(reference, e, &first);
+    if (cert->p == 0 || reference->advance(e, cert->p) != RUNNING) {
+      reject_certificate(cert, "the machine halts within the cycle");
+    } else {
+      take_snapshot(reference, e, &second);
+      if (!same_configuration(&first, &second)) {
+        reject_certificate(cert, "the configuration does not recur");
+      }
+    }
+  } else { // CERTIFICATE_ESCAPE
+    int closed = 0;
+    for (size_t i = 0; i < cert->states_len; ++i) {
+      const struct action* const action = &(cert->states[i].action0);
+      if (cert->escape[i]) {
+        closed = 1;
+        if (action->direction_to_move != cert->direction || !cert->escape[action->next_state->number]) {
+          closed = 0;
+          break;
+        }
+      }
+    }
+    take_snapshot(reference, e, &first);
+    const struct run_info* const info = &(first.info);
+    if (!closed) {
+      reject_certificate(cert, "the set of states is not closed");
+    } else if (!cert->escape[info->state->number]
+               || info->head != (cert->direction == +1 ? info->max_pos : info->min_pos)
+               || first.cells[info->head - info->min_pos] != ' ') {
+      reject_certificate(cert, "the machine has not escaped at the given step");
+    }
+  }
+  reference->destroy(e);
+  free(first.cells);
+  free(second.cells);
+}
+
+static void* verify_worker(void* const arg) {
+  const struct worker* const w = (const struct worker *) arg;
+  struct verification* const v = (struct verification *) w->arg;
+  size_t ix;
+  while ((ix = __atomic_fetch_add(&(v->next_task), 1, __ATOMIC_RELAXED)) < v->tasks_len) {
+    struct certificate* const cert = v->tasks[ix].cert;
+    if (__atomic_load_n(&(cert->failed), __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+    if (cert->kind == CERTIFICATE_HALTS) {
+      verify_segment(cert, v->tasks[ix].segment);
+    } else {
+      verify_nonhalting(cert);
+    }
+  }
+  return NULL;
+}
+
+// Parses a certificate file. On failure, the certificate is marked invalid.
+static void parse_certificate(struct certificate* const cert) {
+  const char* text;
+  read_text_file(cert->file, &text);
+  cert->text = (char *) text;
+  struct buffer configs = {0};
+  struct buffer hashes = {0};
+  int have_machine = 0;
+  int have_tape = 0;
+  int have_result = 0;
+  char err[256];
+  char* line = cert->text;
+  for (size_t line_ix = 0; *line != '\0'; ++line_ix) {
+    char* const eol = strchr(line, '\n');
+    char* const next = eol != NULL ? eol + 1 : line + strlen(line);
+    if (eol != NULL) {
+      *eol = '\0';
+    }
+    int n = 0;
+    unsigned long long step;
+    unsigned long long hash;
+    size_t state;
+    ssize_t head;
+    ssize_t first;
+    if (line_ix == 0) {
+      if (strcmp(line, "penrose-turing certificate 1") != 0) {
+        reject_certificate(cert, "not a certificate");
+        return;
+      }
+    } else if (strncmp(line, "machine ", 8) == 0) {
+      if (tm_parse(line + 8, strlen(line + 8), &(cert->states), &(cert->states_len), err, sizeof(err)) != 0) {
+        reject_certificate(cert, err);
+        return;
+      }
+      have_machine = 1;
+    } else if (strncmp(line, "tape ", 5) == 0) {
+      cert->tape = line + 5;
+      cert->tape_len = strspn(cert->tape, "01");
+      if (cert->tape[cert->tape_len] != '\0') {
+        reject_certificate(cert, "invalid tape");
+        return;
+      }
+      have_tape = 1;
+    } else if (have_machine && sscanf(line, "config %llu %llx %zX %zd %zd%n", &step, &hash, &state, &head, &first, &n) == 5
+               && line[n] == ' ') {
+      ++n; // cells may begin with blanks, so only one separator is skipped
+      const size_t cells_len = strlen(line + n);
+      if (state >= cert->states_len || cells_len == 0 || strspn(line + n, " 01") != cells_len
+          || head < first || head >= first + (ssize_t) cells_len) {
+        reject_certificate(cert, "invalid configuration");
+        return;
+      }
+      struct snapshot snap = {0};
+      snap.info.step = step;
+      snap.info.state = cert->states + state;
+      snap.info.head = head;
+      snap.info.min_pos = first;
+      snap.info.max_pos = first + cells_len - 1;
+      snap.cells = line + n;
+      const uint64_t h = hash;
+      buffer_append(&configs, &snap, sizeof(snap));
+      buffer_append(&hashes, &h, sizeof(h));
+    } else if (sscanf(line, "halts %llu%n", &(cert->halts), &n) == 1 && line[n] == '\0') {
+      cert->kind = CERTIFICATE_HALTS;
+      have_result = 1;
+    } else if (sscanf(line, "cycle %llu %llu%n", &(cert->a), &(cert->p), &n) == 2 && line[n] == '\0') {
+      cert->kind = CERTIFICATE_CYCLE;
+      have_result = 1;
+    } else if (have_machine && sscanf(line, "escape %llu %d%n", &(cert->a), &(cert->direction), &n) == 2
+               && (cert->direction == +1 || cert->direction == -1)) {
+      cert->kind = CERTIFICATE_ESCAPE;
+      cert->escape = (char *) calloc(cert->states_len, 1);
+      if (cert->escape == NULL) {
+        fputs("Out of memory.\n", stderr);
+        exit(1);
+      }
+      for (char* s = line + n; *s != '\0'; ) {
+        char* end;
+        const unsigned long long i = strtoull(s, &end, 16);
+        if (end == s || i >= cert->states_len) {
+          reject_certificate(cert, "invalid escape states");
+          return;
+        }
+        cert->escape[i] = 1;
+        s = end;
+      }
+      have_result = 1;
+    } else {
+      snprintf(err, sizeof(err), "unrecognized line %zu", line_ix + 1);
+      reject_certificate(cert, err);
+      return;
+    }
+    line = next;
+  }
+  cert->configs = (struct snapshot *) configs.data;
+  cert->hashes = (uint64_t *) hashes.data;
+  cert->configs_len = configs.len / sizeof(struct snapshot);
+  if (!have_machine || !have_tape || !have_result) {
+    reject_certificate(cert, "incomplete certificate");
+    return;
+  }
+  if (cert->kind == CERTIFICATE_HALTS) {
+    if (cert->configs_len < 2 || cert->configs[0].info.step != 0
+        || cert->configs[cert->configs_len - 1].info.step != cert->halts) {
+      reject_certificate(cert, "configurations do not span the run");
+      return;
+    }
+    for (size_t i = 1; i < cert->configs_len; ++i) {
+      if (cert->configs[i].info.step <= cert->configs[i - 1].info.step) {
+        reject_certificate(cert, "configurations are out of order");
+        return;
+      }
+    }
+  }
+}
+
+/**
+ * Verifies certificates independently of the engines used to produce them,
+ * using only the parser and the reference engine, and prints one line per
+ * certificate. A halting certificate records the configuration every so
+ * many steps together with its hash, so its segments are re-run in parallel;
+ * with a segment count, only that many randomly chosen segments are re-run.
+ * Non-halting certificates are checked as described for
+ * find_nonhalting_witness().
+ *
+ * Parameters
+ * ----------
+ * files     - certificate files
+ * files_len - number of certificate files
+ * segments  - number of segments to verify per halting certificate, or 0 for all
+ * threads   - number of worker threads
+ *
+ * Returns
+ * -------
+ * exit status: 0 if every certificate is valid, 1 otherwise
+ */
+int verify_certificates(const char* const* const files, const size_t files_len,
+                        const size_t segments, const size_t threads) {
+  struct certificate* const certs = (struct certificate *) calloc(files_len + 1, sizeof(struct certificate));
+  if (certs == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  struct buffer tasks = {0};
+  unsigned int seed = (unsigned int) time(NULL) ^ (unsigned int) getpid();
+  for (size_t i = 0; i < files_len; ++i) {
+    struct certificate* const cert = certs + i;
+    cert->file = files[i];
+    parse_certificate(cert);
+    if (cert->failed) {
+      continue;
+    }
+    struct verify_task task = { cert, 0 };
+    if (cert->kind != CERTIFICATE_HALTS) {
+      buffer_append(&tasks, &task, sizeof(task));
+      continue;
+    }
+    // Choose the segments to verify with a partial Fisher-Yates shuffle.
+    const size_t all = cert->configs_len - 1;
+    size_t* const order = (size_t *) calloc(all, sizeof(size_t));
+    if (order == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    for (size_t j = 0; j < all; ++j) {
+      order[j] = j;
+    }
+    cert->segments_verified = segments != 0 && segments < all ? segments : all;
+    for (size_t j = 0; j < cert->segments_verified; ++j) {
+      const size_t k = j + rand_r(&seed) % (all - j);
+      const size_t tmp = order[j];
+      order[j] = order[k];
+      order[k] = tmp;
+      task.segment = order[j];
+      buffer_append(&tasks, &task, sizeof(task));
+    }
+    free(order);
+  }
+
+  struct verification v = {0};
+  v.tasks = (struct verify_task *) tasks.data;
+  v.tasks_len = tasks.len / sizeof(struct verify_task);
+  run_workers(threads, verify_worker, &v);
+
+  int rc = 0;
+  for (size_t i = 0; i < files_len; ++i) {
+    const struct certificate* const cert = certs + i;
+    if (cert->failed) {
+      printf("%s\tinvalid\t%s\n", cert->file, cert->reason);
+      rc = 1;
+    } else if (cert->kind == CERTIFICATE_HALTS) {
+      printf("%s\thalts\t%llu steps; verified %zu of %zu segments\n", cert->file, cert->halts,
+             cert->segments_verified, cert->configs_len - 1);
+    } else if (cert->kind == CERTIFICATE_CYCLE) {
+      printf("%s\tdoes not halt\tcycle of period %llu from step %llu\n", cert->file, cert->p, cert->a);
+    } else {
+      printf("%s\tdoes not halt\tescapes %s from step %llu\n", cert->file,
+             cert->direction == +1 ? "right" : "left", cert->a);
+    }
+    free(cert->text);
+    free(cert->states);
+    free(cert->configs);
+    free(cert->hashes);
+    free(cert->escape);
+  }
+  free(tasks.data);
+  free(certs);
+  return rc;
+}
+
+/**
+ * Compiles the part of a machine from which the head never moves left to a
+ * transducer. These are the states in the greatest set closed under taking
+ * actions whose actions all move right or stop.
+ *
+ * Parameters
+ * ----------
+ * states     - Turing machine states
+ * states_len - length of array of states
+ *
+ * "Out" Parameters
+ * ----------------
+ * t - transducer; t->closed, t->next and t->write are allocated
+ */
+void compile_transducer(const struct state* const states, const size_t states_len, struct transducer* const t) {
+  t->states_len = states_len;
+  t->closed = (char *) calloc(states_len, sizeof(char));
+  t->next = (uint32_t *) malloc(2 * states_len * sizeof(uint32_t));
+  t->write = (char *) malloc(2 * states_len);
+  if (t->closed == NULL || t->next == NULL || t->write == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  if (states_len >= TRANSDUCER_HALT) {
+    return; // too many states to number; nothing is compiled
+  }
+  for (size_t i = 0; i < states_len; ++i) {
+    t->closed[i] = states[i].action0.direction_to_move != -1 && states[i].action1.direction_to_move != -1;
+  }
+  for (int changed = 1; changed; ) {
+    changed = 0;
+    for (size_t i = 0; i < states_len; ++i) {
+      const struct action* const actions[2] = { &(states[i].action0), &(states[i].action1) };
+      for (int c = 0; c < 2 && t->closed[i]; ++c) {
+        if (actions[c]->direction_to_move == +1 && !t->closed[actions[c]->next_state->number]) {
+          t->closed[i] = 0;
+          changed = 1;
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < states_len; ++i) {
+    const struct action* const actions[2] = { &(states[i].action0), &(states[i].action1) };
+    for (int c = 0; c < 2; ++c) {
+      // States outside the closed set are never entered from within it.
+      t->next[2 * i + c] = !t->closed[i] || actions[c]->direction_to_move != +1
+                           ? TRANSDUCER_HALT : (uint32_t) actions[c]->next_state->number;
+      t->write[2 * i + c] = actions[c]->value_to_write == 0 ? '0' : '1';
+    }
+  }
+}
+
+// Frees the tables of a transducer.
+void free_transducer(struct transducer* const t) {
+  free(t->closed);
+  free(t->next);
+  free(t->write);
+}
+
+/**
+ * Runs a transducer over its input, writing one output cell per input cell
+ * until it halts.
+ *
+ * Parameters
+ * ----------
+ * t     - transducer
+ * start - start state
+ * in    - input cells, '0' or '1'
+ * len   - number of input cells
+ *
+ * "Out" Parameters
+ * ----------------
+ * out - output cells
+ *
+ * Returns
+ * -------
+ * the end state, or TRANSDUCER_HALTED | the offset of the cell at which the
+ * transducer halted
+ */
+uint64_t transduce(const struct transducer* const t, uint32_t start, const char* const in,
+                   const size_t len, char* const out) {
+  const uint32_t* const next = t->next;
+  const char* const write = t->write;
+  uint32_t s = start;
+  for (size_t i = 0; i < len; ++i) {
+    const size_t ix = 2 * s + (in[i] == '1');
+    out[i] = write[ix];
+    s = next[ix];
+    if (s == TRANSDUCER_HALT) {
+      return TRANSDUCER_HALTED | i;
+    }
+  }
+  return s;
+}
+
+/**
+ * Runs a transducer over its input from every start state at once, without
+ * writing output. Runs that reach the same state at the same cell are merged,
+ * so the cost soon approaches that of a single run.
+ *
+ * Parameters
+ * ----------
+ * t   - transducer
+ * in  - input cells, '0' or '1'
+ * len - number of input cells
+ *
+ * "Out" Parameters
+ * ----------------
+ * ends - for each start state, the result transduce() would return
+ */
+void transducer_speculate(const struct transducer* const t, const char* const in, const size_t len,
+                          uint64_t* const ends) {
+  const size_t n = t->states_len;
+  uint32_t* const lane_state = (uint32_t *) malloc(n * sizeof(uint32_t));
+  uint32_t* const lane_alias = (uint32_t *) malloc(n * sizeof(uint32_t)); // lane merged into, or itself
+  uint64_t* const lane_end = (uint64_t *) malloc(n * sizeof(uint64_t));
+  uint32_t* const active = (uint32_t *) malloc(n * sizeof(uint32_t));
+  uint32_t* const owner = (uint32_t *) malloc(n * sizeof(uint32_t)); // lane in each state at a merge
+  size_t* const owner_epoch = (size_t *) calloc(n, sizeof(size_t));
+  if (lane_state == NULL || lane_alias == NULL || lane_end == NULL || active == NULL || owner == NULL
+      || owner_epoch == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  // Lane i starts in state i.
+  for (size_t i = 0; i < n; ++i) {
+    lane_state[i] = lane_alias[i] = active[i] = (uint32_t) i;
+  }
+  size_t active_len = n;
+  size_t epoch = 0;
+  for (size_t i = 0; i < len && active_len > 0; ++i) {
+    const int c = in[i] == '1';
+    for (size_t k = 0; k < active_len; ) {
+      const uint32_t lane = active[k];
+      const uint32_t s = t->next[2 * lane_state[lane] + c];
+      if (s == TRANSDUCER_HALT) {
+        lane_end[lane] = TRANSDUCER_HALTED | i;
+        active[k] = active[--active_len];
+      } else {
+        lane_state[lane] = s;
+        ++k;
+      }
+    }
+    if (active_len > 1 && i % TRANSDUCER_MERGE_INTERVAL == 0) {
+      ++epoch;
+      for (size_t k = 0; k < active_len; ) {
+        const uint32_t lane = active[k];
+        const uint32_t s = lane_state[lane];
+        if (owner_epoch[s] == epoch) {
+          lane_alias[lane] = owner[s];
+          active[k] = active[--active_len];
+        } else {
+          owner_epoch[s] = epoch;
+          owner[s] = lane;
+          ++k;
+        }
+      }
+    }
+  }
+  for (size_t k = 0; k < active_len; ++k) {
+    lane_end[active[k]] = lane_state[active[k]];
+  }
+  for (size_t i = 0; i < n; ++i) {
+    uint32_t lane = (uint32_t) i;
+    while (lane_alias[lane] != lane) {
+      lane = lane_alias[lane];
+    }
+    ends[i] = lane_end[lane];
+  }
+  free(lane_state);
+  free(lane_alias);
+  free(lane_end);
+  free(active);
+  free(owner);
+  free(owner_epoch);
+}
+
+static void* transducer_worker(void* const arg) {
+  const struct worker* const w = (const struct worker *) arg;
+  struct transduction* const td = (struct transduction *) w->arg;
+  size_t ix;
+  while ((ix = __atomic_fetch_add(&(td->next_chunk), 1, __ATOMIC_RELAXED)) < td->chunks_len) {
+    struct transducer_chunk* const chunk = td->chunks + ix;
+    // The first chunk starts in state 0, so it needs no speculation.
+    if (ix > 0 && td->speculate) {
+      transducer_speculate(td->t, chunk->in, chunk->len, chunk->ends);
+    } else if (ix == 0 || !td->speculate) {
+      chunk->end = transduce(td->t, chunk->start, chunk->in, chunk->len, chunk->out);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Runs a machine whose head never moves left as a streaming transducer,
+ * splitting a long tape into chunks that are processed in parallel, and
+ * prints the result. Since every cell the head passes is written, the result
+ * is all of the cells up to the halt.
+ *
+ * The run is left to the engines if the machine may move left, or if it
+ * does not halt within the step and tape limits, so that those are reported
+ * exactly as before.
+ *
+ * Parameters
+ * ----------
+ * states           - Turing machine states
+ * states_len       - length of array of states
+ * initial_tape     - initial tape
+ * initial_tape_len - initial tape length
+ * opts             - run options
+ *
+ * Returns
+ * -------
+ * non-zero if the result was printed, zero if the machine must be run by an
+ * engine
+ */
+int run_transducer(const struct state* const states, const size_t states_len, const char* const initial_tape,
+                   const size_t initial_tape_len, const struct run_options* const opts) {
+  struct transducer t;
+  compile_transducer(states, states_len, &t);
+  if (!t.closed[0]) {
+    free_transducer(&t);
+    return 0;
+  }
+  // Once the input is exhausted the head reads blanks, so the machine either
+  // halts within states_len more cells or never halts.
+  char* const out = (char *) malloc(initial_tape_len + states_len);
+  if (out == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+
+  struct transduction td = {0};
+  td.t = &t;
+  td.chunks_len = initial_tape_len / TRANSDUCER_MIN_CHUNK_LEN;
+  if (td.chunks_len > opts->threads) {
+    td.chunks_len = opts->threads;
+  }
+  if (td.chunks_len == 0) {
+    td.chunks_len = 1;
+  }
+  td.chunks = (struct transducer_chunk *) calloc(td.chunks_len, sizeof(struct transducer_chunk));
+  if (td.chunks == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  for (size_t i = 0; i < td.chunks_len; ++i) {
+    struct transducer_chunk* const chunk = td.chunks + i;
+    const size_t begin = initial_tape_len / td.chunks_len * i;
+    chunk->in = initial_tape + begin;
+    chunk->len = (i + 1 < td.chunks_len ? initial_tape_len / td.chunks_len * (i + 1) : initial_tape_len) - begin;
+    chunk->out = out + begin;
+    if (i > 0) {
+      chunk->ends = (uint64_t *) malloc(states_len * sizeof(uint64_t));
+      if (chunk->ends == NULL) {
+        fputs("Out of memory.\n", stderr);
+        exit(1);
+      }
+    }
+  }
+  td.speculate = 1;
+  run_workers(td.chunks_len < opts->threads ? td.chunks_len : opts->threads, transducer_worker, &td);
+
+  // Follow the speculative results to find the state in which each chunk
+  // starts, then write the chunks up to the halt.
+  uint64_t end = td.chunks[0].end;
+  size_t chunks_len = 1;
+  while (chunks_len < td.chunks_len && !(end & TRANSDUCER_HALTED)) {
+    td.chunks[chunks_len].start = (uint32_t) end;
+    end = td.chunks[chunks_len].ends[end];
+    ++chunks_len;
+  }
+  if (chunks_len > 1) {
+    td.chunks[0].len = 0;
+    td.chunks_len = chunks_len;
+    td.speculate = 0;
+    td.next_chunk = 0;
+    run_workers(chunks_len - 1 < opts->threads ? chunks_len - 1 : opts->threads, transducer_worker, &td);
+  }
+  size_t out_len;
+  if (end & TRANSDUCER_HALTED) {
+    out_len = (td.chunks[chunks_len - 1].out - out) + (end & ~TRANSDUCER_HALTED) + 1;
+  } else {
+    // Run on into the blank cells.
+    char* const visited = (char *) calloc(states_len, sizeof(char));
+    if (visited == NULL) {
+      fputs("Out of memory.\n", stderr);
+      exit(1);
+    }
+    out_len = initial_tape_len;
+    uint32_t s = (uint32_t) end;
+    while (s != TRANSDUCER_HALT && !visited[s]) {
+      visited[s] = 1;
+      out[out_len++] = t.write[2 * s];
+      s = t.next[2 * s];
+    }
+    free(visited);
+    if (s != TRANSDUCER_HALT) {
+      out_len = 0; // never halts
+    }
+  }
+
+  // The machine takes one step per cell, and the working tape spans the
+  // initial tape and the cells it has written.
+  const int handled = out_len > 0 && out_len <= opts->max_steps
+                      && (out_len > initial_tape_len ? out_len : initial_tape_len) <= opts->max_tape_len;
+  if (handled) {
+    fwrite(out, 1, out_len, stdout);
+    putchar('\n');
+  }
+  for (size_t i = 0; i < td.chunks_len; ++i) {
+    free(td.chunks[i].ends);
+  }
+  free(td.chunks);
+  free(out);
+  free_transducer(&t);
+  return handled;
+}
+
+/**
+ * Finishes a run whose machine is in a state from which the head never moves
+ * left, streaming the result to standard output. The cells left of the head
+ * that belong to the result are printed and the engine is destroyed, keeping
+ * only the cells right of the head, which are then fed to the transducer a
+ * block at a time; each block of output is printed as soon as it is produced.
+ * The limits are those of the engines.
+ *
+ * Parameters
+ * ----------
+ * states - Turing machine states
+ * t      - transducer, in whose closed set the machine is
+ * engine - engine
+ * e      - engine instance; destroyed
+ * opts   - run options
+ *
+ * "Out" Parameters
+ * ----------------
+ * info - final position of the machine
+ *
+ * Returns
+ * -------
+ * HALTED, TAPE_LIMIT, or RUNNING if the maximum number of steps was exceeded
+ */
+enum status stream_result(const struct state* const states, const struct transducer* const t,
+                          const struct engine* const engine, void* const e, const struct run_options* const opts,
+                          struct run_info* const info) {
+  char* const block = (char *) malloc(STREAM_BLOCK_LEN);
+  char* const out = (char *) malloc(STREAM_BLOCK_LEN);
+  if (block == NULL || out == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  engine->get_info(e, info);
+
+  // The result starts after the last blank left of the head.
+  ssize_t first = info->min_pos;
+  for (ssize_t end = info->head; end > info->min_pos && first == info->min_pos; ) {
+    const ssize_t begin = end - (ssize_t) STREAM_BLOCK_LEN > info->min_pos
+                          ? end - (ssize_t) STREAM_BLOCK_LEN : info->min_pos;
+    engine->read_cells(e, begin, end - begin, block);
+    for (ssize_t pos = end - 1; pos >= begin; --pos) {
+      if (block[pos - begin] == ' ') {
+        first = pos + 1;
+        break;
+      }
+    }
+    end = begin;
+  }
+  for (ssize_t pos = first; pos < info->head; pos += STREAM_BLOCK_LEN) {
+    const size_t left = (size_t) (info->head - pos);
+    const size_t n = left < STREAM_BLOCK_LEN ? left : STREAM_BLOCK_LEN;
+    engine->read_cells(e, pos, n, block);
+    fwrite(block, 1, n, stdout);
+  }
+
+  // Keep only the cells the head has yet to read.
+  const ssize_t rest_pos = info->head;
+  const size_t rest_len = info->max_pos - info->head + 1;
+  char* const rest = (char *) malloc(rest_len);
+  if (rest == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  engine->read_cells(e, rest_pos, rest_len, rest);
+  engine->destroy(e);
+
+  enum status status = RUNNING;
+  uint32_t s = (uint32_t) info->state->number;
+  memset(block, '0', STREAM_BLOCK_LEN);
+  while (status == RUNNING && info->step < opts->max_steps) {
+    // The tape spans from info->min_pos to the head or beyond. Sizes are
+    // kept unsigned so that an unlimited tape (SIZE_MAX) cannot wrap.
+    if ((size_t) (info->max_pos - info->min_pos + 1) > opts->max_tape_len) {
+      status = TAPE_LIMIT;
+      break;
+    }
+    const size_t room = opts->max_tape_len - (size_t) (info->head - info->min_pos); // cells from the head on
+    const char* in;
+    size_t n;
+    if (info->head < rest_pos + (ssize_t) rest_len) {
+      in = rest + (info->head - rest_pos);
+      n = rest_pos + rest_len - info->head;
+    } else {
+      in = block;
+      n = STREAM_BLOCK_LEN;
+    }
+    if (n > room) {
+      n = room;
+    }
+    if (n > STREAM_BLOCK_LEN) {
+      n = STREAM_BLOCK_LEN;
+    }
+    if (n > opts->max_steps - info->step) {
+      n = opts->max_steps - info->step;
+    }
+    const uint64_t end = transduce(t, s, in, n, out);
+    if (end & TRANSDUCER_HALTED) {
+      n = (end & ~TRANSDUCER_HALTED) + 1;
+      info->head += n - 1;
+      status = HALTED;
+    } else {
+      info->head += n;
+      s = (uint32_t) end;
+    }
+    info->step += n;
+    if (info->head > info->max_pos) {
+      info->max_pos = info->head;
+    }
+    fwrite(out, 1, n, stdout);
+  }
+  info->state = states + s;
+  free(rest);
+  free(block);
+  free(out);
+  return status;
+}
+
+// Sleeps while *addr is val, for at most timeout if it is not NULL.
+static void futex_wait(uint32_t* const addr, const uint32_t val, const struct timespec* const timeout) {
+  syscall(SYS_futex, addr, FUTEX_WAIT, val, timeout, NULL, 0);
+}
+
+static void futex_wake(uint32_t* const addr) {
+  syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// Adds a slot number to a ring; returns zero if the ring is full.
+static int shm_ring_push(struct shm_ring* const r, const uint64_t mask, const uint64_t slot) {
+  uint64_t pos = __atomic_load_n(&(r->enqueue_pos), __ATOMIC_RELAXED);
+  for (;;) {
+    const uint64_t seq = __atomic_load_n(&(r->cells[pos & mask].seq), __ATOMIC_ACQUIRE);
+    const int64_t dif = (int64_t) (seq - pos);
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&(r->enqueue_pos), &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        r->cells[pos & mask].slot = slot;
+        __atomic_store_n(&(r->cells[pos & mask].seq), pos + 1, __ATOMIC_RELEASE);
+        return 1;
+      }
+    } else if (dif < 0) {
+      return 0;
+    } else {
+      pos = __atomic_load_n(&(r->enqueue_pos), __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// Takes a slot number from a ring; returns zero if the ring is empty.
+static int shm_ring_pop(struct shm_ring* const r, const uint64_t mask, uint64_t* const slot) {
+  uint64_t pos = __atomic_load_n(&(r->dequeue_pos), __ATOMIC_RELAXED);
+  for (;;) {
+    const uint64_t seq = __atomic_load_n(&(r->cells[pos & mask].seq), __ATOMIC_ACQUIRE);
+    const int64_t dif = (int64_t) (seq - (pos + 1));
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&(r->dequeue_pos), &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *slot = r->cells[pos & mask].slot;
+        __atomic_store_n(&(r->cells[pos & mask].seq), pos + mask + 1, __ATOMIC_RELEASE);
+        return 1;
+      }
+    } else if (dif < 0) {
+      return 0;
+    } else {
+      pos = __atomic_load_n(&(r->dequeue_pos), __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void shm_check_server(const struct shm_queue* q);
+
+// Takes a slot number from a ring, sleeping on the futex counter until one
+// is pushed. Returns zero if stop is set and the ring is empty. A client
+// passes its queue as watched, and exits if the server does while it sleeps.
+static int shm_ring_pop_wait(struct shm_ring* const r, const uint64_t mask, uint32_t* const counter,
+                             uint32_t* const waiters, const uint32_t* const stop,
+                             const struct shm_queue* const watched, uint64_t* const slot) {
+  const struct timespec interval = { 0, SHM_LIVENESS_INTERVAL_NS };
+  for (;;) {
+    if (shm_ring_pop(r, mask, slot)) {
+      return 1;
+    }
+    const uint32_t seen = __atomic_load_n(counter, __ATOMIC_SEQ_CST);
+    if (stop != NULL && __atomic_load_n(stop, __ATOMIC_SEQ_CST)) {
+      return 0;
+    }
+    __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    if (shm_ring_pop(r, mask, slot)) {
+      __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+      return 1;
+    }
+    futex_wait(counter, seen, watched != NULL ? &interval : NULL);
+    __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    if (watched != NULL) {
+      shm_check_server(watched);
+    }
+  }
+}
+
+// Pushes a slot number to a ring and wakes any sleepers.
+static void shm_ring_push_wake(struct shm_ring* const r, const uint64_t mask, uint32_t* const counter,
+                               uint32_t* const waiters, const uint64_t slot) {
+  shm_ring_push(r, mask, slot); // cannot fail; there are only as many slots as cells
+  __atomic_add_fetch(counter, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST) > 0) {
+    futex_wake(counter);
+  }
+}
+
+// Finds the parts of a mapped queue from its header.
+static void shm_queue_layout(struct shm_queue* const q) {
+  q->header = (struct shm_queue_header *) q->base;
+  q->free = (struct shm_ring *) (q->base + q->header->free_offset);
+  q->submit = (struct shm_ring *) (q->base + q->header->submit_offset);
+  q->jobs = (struct shm_job *) (q->base + q->header->jobs_offset);
+  q->data = q->base + q->header->data_offset;
+}
+
+// Maps an existing queue, exiting if it is not one.
+static void open_shm_queue(const char* const name, struct shm_queue* const q) {
+  char path[4096];
+  snprintf(path, sizeof(path), "/dev/shm/%s", name);
+  q->name = name;
+  q->fd = open(path, O_RDWR);
+  struct stat st;
+  if (q->fd == -1 || fstat(q->fd, &st) != 0) {
+    fprintf(stderr, "Error opening file %s.\n", path);
+    exit(1);
+  }
+  q->len = st.st_size;
+  q->base = q->len < sizeof(struct shm_queue_header) ? MAP_FAILED
+            : (char *) mmap(NULL, q->len, PROT_READ | PROT_WRITE, MAP_SHARED, q->fd, 0);
+  if (q->base == MAP_FAILED || memcmp(((struct shm_queue_header *) q->base)->magic, SHM_MAGIC, 8) != 0) {
+    fprintf(stderr, "%s is not a job queue.\n", path);
+    exit(1);
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  shm_queue_layout(q);
+}
+
+// Exits with an error if the server of a mapped queue is no longer running,
+// which is when its lock on the queue can be taken, removing the queue
+// unless it has been replaced.
+static void shm_check_server(const struct shm_queue* const q) {
+  if (flock(q->fd, LOCK_SH | LOCK_NB) != 0) {
+    return;
+  }
+  char path[4096];
+  snprintf(path, sizeof(path), "/dev/shm/%s", q->name);
+  struct stat st;
+  struct stat path_st;
+  if (fstat(q->fd, &st) == 0 && stat(path, &path_st) == 0 && st.st_ino == path_st.st_ino) {
+    unlink(path);
+  }
+  fprintf(stderr, "The server of job queue %s has exited.\n", path);
+  exit(1);
+}
+
+// Serves as the signal handler of a server: waits for SIGINT or SIGTERM,
+// which ask the server to stop as --stop-server does, or for SIGUSR1, which
+// the server sends once it has stopped.
+static void* shm_signal_thread(void* const arg) {
+  struct shm_queue_header* const h = (struct shm_queue_header *) arg;
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGTERM);
+  sigaddset(&set, SIGUSR1);
+  int sig;
+  while (sigwait(&set, &sig) == 0 && sig != SIGUSR1) {
+    __atomic_store_n(&(h->stop), 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&(h->submitted), 1, __ATOMIC_SEQ_CST);
+    futex_wake(&(h->submitted));
+  }
+  return NULL;
+}
+
+// Records the outcome of a job in its slot.
+static void finish_job(const struct server* const srv, const uint64_t slot,
+                       const enum shm_job_status status, const char* const result, const size_t result_len) {
+  struct shm_job* const job = srv->q->jobs + slot;
+  char* const data = srv->q->data + slot * srv->slot_data_len;
+  job->status = status;
+  job->result_len = result_len < srv->slot_data_len ? result_len : srv->slot_data_len;
+  memcpy(data, result, job->result_len);
+  __atomic_store_n(&(job->state), JOB_DONE, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&(job->waiting), __ATOMIC_SEQ_CST)) {
+    futex_wake(&(job->state));
+  }
+}
+
+static void* serve_worker(void* const arg) {
+  const struct worker* const w = (const struct worker *) arg;
+  struct server* const srv = (struct server *) w->arg;
+  struct run_pool pool = {0};
+  const struct bundle* const bundle = node_bundle(srv->replicas, w->node);
+  const struct shm_queue* const q = srv->q;
+  struct shm_queue_header* const h = q->header;
+  struct buffer result = {0};
+  uint64_t slot;
+  while (shm_ring_pop_wait(q->submit, srv->slots_len - 1, &(h->submitted), &(h->submit_waiters), &(h->stop), NULL,
+                           &slot)) {
+    if (slot >= srv->slots_len) {
+      continue; // not a slot of this queue; there is no job to answer
+    }
+    struct shm_job* const job = q->jobs + slot;
+    // The tape is read in place.
+    const char* const tape = q->data + slot * srv->slot_data_len;
+    char err[256];
+    struct state* states;
+    size_t states_len;
+    if (job->tape_len >= srv->slot_data_len || tape[job->tape_len] != '\0'
+        || strspn(tape, "01") != job->tape_len) {
+      finish_job(srv, slot, JOB_INVALID, "invalid tape", 12);
+    } else if (job->max_steps == 0 || job->max_tape_len == 0) {
+      finish_job(srv, slot, JOB_INVALID, "invalid limits", 14);
+    } else if (job->machine >= bundle->header->machines_len) {
+      finish_job(srv, slot, JOB_INVALID, "no such machine", 15);
+    } else if (bundle_load(bundle, job->machine, &pool, &states, &states_len, err, sizeof(err)) != 0) {
+      finish_job(srv, slot, JOB_INVALID, err, strlen(err));
+    } else {
+      struct run_options opts = *(srv->opts);
+      opts.pool = &pool;
+      opts.max_steps = job->max_steps;
+      opts.max_tape_len = job->max_tape_len;
+      struct run_info info;
+      result.len = 0;
+      const enum status status = run_machine(states, states_len, tape, job->tape_len, &opts, &info, &result);
+      pool_free(&pool, states);
+      job->steps = info.step;
+      if (status == HALTED && result.len > srv->slot_data_len) {
+        finish_job(srv, slot, JOB_INVALID, "result too long", 15);
+      } else {
+        finish_job(srv, slot, status == HALTED ? JOB_HALTED : status == TAPE_LIMIT ? JOB_MAX_TAPE_LEN : JOB_MAX_STEPS,
+                   result.data, status == HALTED ? result.len : 0);
+      }
+    }
+  }
+  __atomic_add_fetch(&(srv->allocs), pool.allocs, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&(srv->reuses), pool.reuses, __ATOMIC_RELAXED);
+  destroy_pool(&pool);
+  free(result.data);
+  return NULL;
+}
+
+/**
+ * Serves jobs from a shared-memory queue, creating it as /dev/shm/name, until
+ * a client asks the server to stop and the submitted jobs are done. Clients
+ * map the queue, take a free slot, write the tape into the slot's data and
+ * push the slot to the submission ring; the worker threads read the tape in
+ * place, run the machine from the bundle and write the result over it. No
+ * system calls are made unless someone has to sleep. SIGINT and SIGTERM stop
+ * the server as --stop-server does, and the queue is removed either way.
+ *
+ * Parameters
+ * ----------
+ * bundle        - bundle of machines
+ * name          - name of the queue in /dev/shm
+ * opts          - run options; only the engine is used, the limits come with each job
+ * threads       - number of worker threads
+ * slots_len     - number of job slots, a power of two
+ * slot_data_len - bytes for the tape and result of each job
+ *
+ * Returns
+ * -------
+ * exit status
+ */
+int serve_jobs(const struct bundle* const bundle, const char* const name, const struct run_options* const opts,
+               const size_t threads, const size_t slots_len, const size_t slot_data_len) {
+  struct shm_queue q = {0};
+  q.name = name;
+  const size_t ring_len = sizeof(struct shm_ring) + slots_len * 2 * sizeof(uint64_t);
+  const size_t free_offset = (sizeof(struct shm_queue_header) + 63) & ~(size_t) 63;
+  const size_t submit_offset = free_offset + ((ring_len + 63) & ~(size_t) 63);
+  const size_t jobs_offset = submit_offset + ((ring_len + 63) & ~(size_t) 63);
+  const size_t data_offset = (jobs_offset + slots_len * sizeof(struct shm_job) + 4095) & ~(size_t) 4095;
+  q.len = data_offset + slots_len * slot_data_len;
+
+  char path[4096];
+  snprintf(path, sizeof(path), "/dev/shm/%s", name);
+  // A queue left behind by a server that has exited is reused.
+  q.fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (q.fd == -1) {
+    fprintf(stderr, "Error creating file %s.\n", path);
+    exit(1);
+  }
+  if (flock(q.fd, LOCK_EX | LOCK_NB) != 0) {
+    fprintf(stderr, "Job queue %s is already being served.\n", path);
+    exit(1);
+  }
+  if (ftruncate(q.fd, 0) != 0 || ftruncate(q.fd, q.len) != 0) {
+    fprintf(stderr, "Error creating file %s.\n", path);
+    exit(1);
+  }
+  q.base = (char *) mmap(NULL, q.len, PROT_READ | PROT_WRITE, MAP_SHARED, q.fd, 0);
+  if (q.base == MAP_FAILED) {
+    fprintf(stderr, "Error mapping file %s.\n", path);
+    exit(1);
+  }
+  struct shm_queue_header* const h = (struct shm_queue_header *) q.base;
+  h->slots_len = slots_len;
+  h->slot_data_len = slot_data_len;
+  h->free_offset = free_offset;
+  h->submit_offset = submit_offset;
+  h->jobs_offset = jobs_offset;
+  h->data_offset = data_offset;
+  shm_queue_layout(&q);
+  for (size_t i = 0; i < slots_len; ++i) {
+    q.free->cells[i].seq = i;
+    q.submit->cells[i].seq = i;
+  }
+  for (size_t i = 0; i < slots_len; ++i) {
+    shm_ring_push(q.free, slots_len - 1, i);
+  }
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(h->magic, SHM_MAGIC, 8);
+
+  struct server srv = {0};
+  srv.q = &q;
+  srv.slots_len = slots_len;
+  srv.slot_data_len = slot_data_len;
+  srv.opts = opts;
+  struct bundle_replicas replicas;
+  init_bundle_replicas(&replicas, bundle);
+  srv.replicas = &replicas;
+  // Signals are taken by a thread of their own, so that an interrupted
+  // server still removes its queue.
+  sigset_t signals;
+  sigset_t old_signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+  pthread_t signal_thread;
+  if (pthread_create(&signal_thread, NULL, shm_signal_thread, h) != 0) {
+    fputs("Error creating signal thread.\n", stderr);
+    exit(1);
+  }
+  run_workers(threads, serve_worker, &srv);
+  pthread_kill(signal_thread, SIGUSR1);
+  pthread_join(signal_thread, NULL);
+  pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+  free_bundle_replicas(&replicas);
+  if (opts->stats) {
+    print_pool_stats(srv.allocs, srv.reuses);
+  }
+
+  unlink(path);
+  munmap(q.base, q.len);
+  close(q.fd);
+  return 0;
+}
+
+// Waits for a job submitted by this client and prints its outcome in the
+// format of --batch, then frees the slot.
+static void collect_job(const struct shm_queue* const q, const uint64_t slot) {
+  struct shm_queue_header* const h = q->header;
+  struct shm_job* const job = q->jobs + slot;
+  const struct timespec interval = { 0, SHM_LIVENESS_INTERVAL_NS };
+  while (__atomic_load_n(&(job->state), __ATOMIC_SEQ_CST) != JOB_DONE) {
+    __atomic_store_n(&(job->waiting), 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&(job->state), __ATOMIC_SEQ_CST) != JOB_DONE) {
+      futex_wait(&(job->state), JOB_SUBMITTED, &interval);
+      if (__atomic_load_n(&(job->state), __ATOMIC_SEQ_CST) != JOB_DONE) {
+        shm_check_server(q);
+      }
+    }
+  }
+  const char* const data = q->data + slot * h->slot_data_len;
+  printf("%llu\t", (unsigned long long) job->machine);
+  if (job->status == JOB_HALTED) {
+    fputs("halted\t", stdout);
+    fwrite(data, 1, job->result_len, stdout);
+  } else if (job->status == JOB_INVALID) {
+    fputs("invalid\t", stdout);
+    fwrite(data, 1, job->result_len, stdout);
+  } else {
+    fputs(job->status == JOB_MAX_TAPE_LEN ? "max-tape-length" : "max-steps", stdout);
+  }
+  putchar('\n');
+  job->state = JOB_FREE;
+  shm_ring_push_wake(q->free, h->slots_len - 1, &(h->freed), &(h->free_waiters), slot);
+}
+
+/**
+ * Submits jobs read from standard input to a shared-memory queue, one per
+ * line as a machine index and a tape separated by a space, keeping as many
+ * in flight as there are free slots. The tape is read straight into the
+ * slot. With a tape corpus, each line holds a machine index and a tape
+ * index instead. Results are printed in the order of the input.
+ *
+ * Parameters
+ * ----------
+ * name         - name of the queue in /dev/shm
+ * corpus       - tape corpus, or NULL
+ * max_steps    - step limit for each job
+ * max_tape_len - tape length limit for each job
+ *
+ * Returns
+ * -------
+ * exit status
+ */
+int submit_jobs(const char* const name, const struct tape_corpus* const corpus,
+                const unsigned long long max_steps, const unsigned long long max_tape_len) {
+  struct shm_queue q;
+  open_shm_queue(name, &q);
+  struct shm_queue_header* const h = q.header;
+  const uint64_t mask = h->slots_len - 1;
+  // Slots in flight, oldest first.
+  uint64_t* const pending = (uint64_t *) malloc(h->slots_len * sizeof(uint64_t));
+  if (pending == NULL) {
+    fputs("Out of memory.\n", stderr);
+    exit(1);
+  }
+  size_t pending_first = 0;
+  size_t pending_len = 0;
+  struct buffer tape = {0};
+  for (;;) {
+    unsigned long long machine;
+    unsigned long long tape_ix = 0;
+    const int fields = corpus ? scanf("%llu %llu", &machine, &tape_ix) : scanf("%llu", &machine);
+    if (fields != (corpus ? 2 : 1)) {
+      break;
+    }
+    // The separator, or the end of a line with an empty tape. Anything else
+    // is left to be read as part of the tape, which the server rejects.
+    const int sep = getchar();
+    if (sep != ' ' && sep != '\t' && sep != '\n' && sep != EOF) {
+      ungetc(sep, stdin);
+    }
+    uint64_t slot;
+    while (!shm_ring_pop(q.free, mask, &slot)) {
+      if (pending_len > 0) {
+        collect_job(&q, pending[pending_first]);
+        pending_first = (pending_first + 1) & mask;
+        --pending_len;
+      } else {
+        shm_ring_pop_wait(q.free, mask, &(h->freed), &(h->free_waiters), NULL, &q, &slot);
+        break;
+      }
+    }
+    struct shm_job* const job = q.jobs + slot;
+    char* const data = q.data + slot * h->slot_data_len;
+    size_t len = 0;
+    if (corpus) {
+      const ssize_t tape_len = tape_ix < corpus->header->tapes_len ? corpus_tape(corpus, tape_ix, &tape) : -1;
+      // An invalid entry is sent as an empty tape with a stray cell, which the server rejects.
+      const char* const cells = tape_len < 0 ? "x" : tape.data;
+      len = tape_len < 0 ? 1 : (size_t) tape_len;
+      memcpy(data, cells, len + 1 < h->slot_data_len ? len : 0);
+    } else if (sep != '\n' && sep != EOF) {
+      int c;
+      while ((c = getchar()) != EOF && c != '\n') {
+        if (len + 1 < h->slot_data_len) {
+          data[len] = (char) c;
+        }
+        ++len;
+      }
+    }
+    if (len + 1 >= h->slot_data_len) {
+      len = h->slot_data_len; // marks the tape as too long
+    } else {
+      data[len] = '\0';
+    }
+    job->machine = machine;
+    job->max_steps = max_steps;
+    job->max_tape_len = max_tape_len;
+    job->tape_len = len;
+    job->waiting = 0;
+    job->state = JOB_SUBMITTED;
+    shm_ring_push_wake(q.submit, mask, &(h->submitted), &(h->submit_waiters), slot);
+    pending[(pending_first + pending_len) & mask] = slot;
+    ++pending_len;
+  }
+  while (pending_len > 0) {
+    collect_job(&q, pending[pending_first]);
+    pending_first = (pending_first + 1) & mask;
+    --pending_len;
+  }
+  free(tape.data);
+  free(pending);
+  munmap(q.base, q.len);
+  close(q.fd);
+  return 0;
+}
+
+/**
+ * Asks the server of a shared-memory queue to finish once the submitted jobs
+ * are done.
+ *
+ * Parameters
+ * ----------
+ * name - name of the queue in /dev/shm
+ *
+ * Returns
+ * -------
+ * exit status
+ */
+int stop_server(const char* const name) {
+  struct shm_queue q;
+  open_shm_queue(name, &q);
+  __atomic_store_n(&(q.header->stop), 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&(q.header->submitted), 1, __ATOMIC_SEQ_CST);
+  futex_wake(&(q.header->submitted));
+  munmap(q.base, q.len);
+  close(q.fd);
+  return 0;
 }